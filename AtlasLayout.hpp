@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+#include "typesDefinition.hpp"
+
+// Where the regions of ThumbnailAtlas go in its pages, kept apart from the
+// textures so it does not need a renderer.
+//
+// Each page is split in horizontal shelves. A region goes to the shelf with
+// the smallest height that fits it, or opens a new shelf below the last
+// one. The thumbnails have at most thumbnailSize pixels per side, so the
+// shelves waste little space. Erased regions are reused by thumbnails that
+// fit in them, and what is left of them is split in two free rects for the
+// next ones. A page is reset once all its regions are erased.
+class AtlasLayout {
+  public:
+    AtlasLayout(int pageSize = 0);
+
+    // A free region in the pages, nullopt when none of them has room left
+    auto allocate(int width, int height) -> std::optional<AtlasRegion>;
+    // Adds an empty page, in the slot of a released one if there is, so the
+    // regions of the other pages keep their index. Returns its index.
+    auto addPage() -> int;
+    // Returns what has to be cleared in the page: the region with its
+    // padding, or the whole page once it is empty
+    auto erase(const AtlasRegion& region) -> SDL_Rect;
+    // Releases the empty pages except one, so inserting a few thumbnails
+    // does not add a page again. Returns their indices.
+    auto releaseEmptyPages() -> std::vector<int>;
+
+    // Pages not released, empty or not
+    auto numPages() const -> int;
+
+  private:
+    struct Shelf {
+        int y;
+        int height;
+        int usedWidth;
+    };
+
+    struct Page {
+        bool released{false};
+        std::vector<Shelf> shelves;
+        int usedHeight{0};
+        int numRegions{0};
+        // Erased regions, with their padding
+        std::vector<SDL_Rect> freeRects;
+    };
+
+    auto allocateInPage(Page& page, int width, int height)
+        -> std::optional<SDL_Rect>;
+
+    // Transparent gap between regions, so the bilinear filter never samples
+    // the neighbour thumbnails. It is not needed at the page edges, which
+    // lets four 512 pixel thumbnails fit in a 2048 row.
+    constexpr static int kPadding = 1;
+
+    std::vector<Page> pages;
+    int pageSize;
+};
+
+//**************************************************************
+//********************* Implementation *************************
+//**************************************************************
+
+AtlasLayout::AtlasLayout(int pageSize) : pageSize(pageSize) {}
+
+auto AtlasLayout::allocate(int width, int height)
+    -> std::optional<AtlasRegion> {
+    if (width > pageSize || height > pageSize) {
+        return std::nullopt;
+    }
+    for (std::size_t i = 0; i < pages.size(); ++i) {
+        if (pages[i].released) {
+            continue;
+        }
+        auto rect = allocateInPage(pages[i], width, height);
+        if (rect) {
+            return AtlasRegion{(int)i, rect.value()};
+        }
+    }
+    return std::nullopt;
+}
+
+auto AtlasLayout::addPage() -> int {
+    auto released =
+        std::find_if(pages.begin(), pages.end(),
+                     [](const Page& page) { return page.released; });
+    if (released == pages.end()) {
+        released = pages.insert(pages.end(), Page{});
+    }
+    // A released page is empty, with no shelves left
+    released->released = false;
+    return (int)(released - pages.begin());
+}
+
+auto AtlasLayout::erase(const AtlasRegion& region) -> SDL_Rect {
+    auto& page = pages[region.page];
+    page.numRegions -= 1;
+    if (page.numRegions == 0) {
+        page.shelves.clear();
+        page.freeRects.clear();
+        page.usedHeight = 0;
+        return SDL_Rect{0, 0, pageSize, pageSize};
+    }
+    SDL_Rect paddedRect{region.rect.x, region.rect.y, region.rect.w + kPadding,
+                        region.rect.h + kPadding};
+    page.freeRects.push_back(paddedRect);
+    return paddedRect;
+}
+
+auto AtlasLayout::releaseEmptyPages() -> std::vector<int> {
+    std::vector<int> releasedPages;
+    bool keptEmpty = false;
+    for (std::size_t i = 0; i < pages.size(); ++i) {
+        if (pages[i].released || pages[i].numRegions > 0) {
+            continue;
+        }
+        if (!keptEmpty) {
+            keptEmpty = true;
+            continue;
+        }
+        pages[i].released = true;
+        releasedPages.push_back((int)i);
+    }
+    return releasedPages;
+}
+
+auto AtlasLayout::numPages() const -> int {
+    return (int)std::count_if(pages.begin(), pages.end(),
+                              [](const Page& page) { return !page.released; });
+}
+
+auto AtlasLayout::allocateInPage(Page& page, int width, int height)
+    -> std::optional<SDL_Rect> {
+    int paddedWidth  = width + kPadding;
+    int paddedHeight = height + kPadding;
+
+    // The smallest erased region that fits
+    auto bestFree = page.freeRects.end();
+    for (auto it = page.freeRects.begin(); it != page.freeRects.end(); ++it) {
+        if (it->w >= paddedWidth && it->h >= paddedHeight &&
+            (bestFree == page.freeRects.end() ||
+             it->w * it->h < bestFree->w * bestFree->h)) {
+            bestFree = it;
+        }
+    }
+    if (bestFree != page.freeRects.end()) {
+        SDL_Rect freeRect = *bestFree;
+        page.freeRects.erase(bestFree);
+        // Guillotine split of the rest, along the side that leaves the
+        // biggest rect, so a 512 region can hold several 128 ones
+        int rightWidth   = freeRect.w - paddedWidth;
+        int bottomHeight = freeRect.h - paddedHeight;
+        SDL_Rect right{freeRect.x + paddedWidth, freeRect.y, rightWidth,
+                       freeRect.h};
+        SDL_Rect bottom{freeRect.x, freeRect.y + paddedHeight, paddedWidth,
+                        bottomHeight};
+        if (rightWidth * freeRect.h < freeRect.w * bottomHeight) {
+            right.h  = paddedHeight;
+            bottom.w = freeRect.w;
+        }
+        for (const auto& rest : {right, bottom}) {
+            if (rest.w > kPadding && rest.h > kPadding) {
+                page.freeRects.push_back(rest);
+            }
+        }
+        page.numRegions += 1;
+        return SDL_Rect{freeRect.x, freeRect.y, width, height};
+    }
+
+    Shelf* bestShelf = nullptr;
+    for (auto& shelf : page.shelves) {
+        if (shelf.height >= paddedHeight &&
+            shelf.usedWidth + width <= pageSize &&
+            (bestShelf == nullptr || shelf.height < bestShelf->height)) {
+            bestShelf = &shelf;
+        }
+    }
+    // A much taller shelf would waste most of its height, open a new one
+    // while there is room for it
+    bool canOpenShelf = page.usedHeight + height <= pageSize;
+    if (bestShelf != nullptr &&
+        (!canOpenShelf || 2 * bestShelf->height <= 3 * paddedHeight)) {
+        SDL_Rect rect{bestShelf->usedWidth, bestShelf->y, width, height};
+        bestShelf->usedWidth += paddedWidth;
+        page.numRegions += 1;
+        return rect;
+    }
+    if (!canOpenShelf) {
+        return std::nullopt;
+    }
+    page.shelves.push_back({page.usedHeight, paddedHeight, paddedWidth});
+    page.usedHeight += paddedHeight;
+    page.numRegions += 1;
+    return SDL_Rect{0, page.shelves.back().y, width, height};
+}
@@ -0,0 +1,570 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "SDL.h"
+
+// Decodes a GIF one frame at a time, composing each frame over the previous
+// ones in a RGBA32 canvas with the disposal methods of the file. Only the
+// canvas, and the area a frame with the "restore previous" disposal covers,
+// are kept in memory, whatever the number of frames.
+//
+// To seek, a copy of the canvas is kept every few frames as a checkpoint,
+// and a frame is composed again from the nearest checkpoint before it. The
+// checkpoints are thinned out as the frames go on, so they stay under
+// kMaxCheckpointBytes.
+class GifDecoder {
+  public:
+    // Reads the header. Returns std::nullopt if the file is not a GIF.
+    static auto open(const std::string& filename) -> std::optional<GifDecoder>;
+
+    // Composes the next frame on the canvas. Returns false at the end of the
+    // file, or if the frame is corrupt.
+    auto decodeNextFrame() -> bool;
+    // Goes back to before the first frame, with a transparent canvas
+    void rewind();
+    // Composes the frame with that index. Returns false if there is no such
+    // frame, leaving the canvas at the last one.
+    auto seekToFrame(int index) -> bool;
+
+    // width * height RGBA32 pixels, with the last decoded frame
+    auto getCanvas() const -> const Uint8*;
+    // Area of the canvas changed since the previous call, the whole canvas
+    // after open, rewind or a seek
+    auto takeDirtyRect() -> SDL_Rect;
+    auto getWidth() const -> int;
+    auto getHeight() const -> int;
+    // Index of the last decoded frame, from 0
+    auto getFrameIndex() const -> int;
+    // Milliseconds the last decoded frame is shown, as stored in the file
+    auto getFrameDelay() const -> int;
+    // 0 until the end of the file has been reached once
+    auto getNumFrames() const -> int;
+    // Bytes of the canvas, the checkpoints and the buffers of the decoder
+    auto getMemory() const -> long;
+
+  private:
+    // Everything needed to go on decoding after frameIndex
+    struct Checkpoint {
+        int frameIndex;
+        std::streampos position;
+        int frameDelay;
+        std::vector<Uint8> canvas;
+        int pendingDisposal;
+        SDL_Rect pendingRect;
+        std::vector<Uint8> savedPixels;
+    };
+
+    constexpr static int kCheckpointInterval   = 16;
+    constexpr static long kMaxCheckpointBytes = 64L * 1024 * 1024;
+    // Larger logical screens are taken as a corrupt header
+    constexpr static long kMaxCanvasPixels = 16384L * 16384;
+
+    GifDecoder() = default;
+
+    auto composeNextFrame() -> bool;
+    void maybeAddCheckpoint();
+    void restoreCheckpoint(const Checkpoint& checkpoint);
+
+    auto readByte() -> int;
+    auto readLittleEndian16() -> int;
+    auto readColorTable(int size) -> std::vector<Uint8>;
+    auto readSubBlocks(std::vector<Uint8>* data) -> bool;
+    // Decompresses the LZW data of a frame into its color indices. Returns
+    // the number of pixels decoded, less than numPixels if it is corrupt.
+    auto decompress(int minCodeSize, std::size_t numPixels) -> std::size_t;
+    void disposePreviousFrame();
+    auto getCanvasPixel(int x, int y) -> Uint8*;
+
+    std::ifstream file;
+    std::streampos firstBlockPosition;
+    int width{0};
+    int height{0};
+    std::vector<Uint8> globalColorTable;
+    std::vector<Uint8> canvas;
+    SDL_Rect dirtyRect{0, 0, 0, 0};
+
+    int frameIndex{-1};
+    int frameDelay{0};
+    int numFrames{0};
+    // Graphic control extension of the next frame
+    int disposal{0};
+    int delay{0};
+    int transparentIndex{-1};
+
+    // What the previous frame asked to do before drawing the next one
+    int pendingDisposal{0};
+    SDL_Rect pendingRect{0, 0, 0, 0};
+    std::vector<Uint8> savedPixels;
+
+    // Sorted by frame, one every checkpointInterval frames
+    std::vector<Checkpoint> checkpoints;
+    int checkpointInterval{kCheckpointInterval};
+    long checkpointBytes{0};
+
+    // Reused between frames
+    std::vector<Uint8> compressed;
+    std::vector<Uint8> indices;
+};
+
+//**************************************************************
+//********************* Implementation *************************
+//**************************************************************
+
+auto GifDecoder::open(const std::string& filename)
+    -> std::optional<GifDecoder> {
+    GifDecoder decoder;
+    decoder.file.open(filename, std::ios::binary);
+    char signature[6];
+    if (!decoder.file.read(signature, 6) ||
+        (std::memcmp(signature, "GIF87a", 6) != 0 &&
+         std::memcmp(signature, "GIF89a", 6) != 0)) {
+        return std::nullopt;
+    }
+    decoder.width  = decoder.readLittleEndian16();
+    decoder.height = decoder.readLittleEndian16();
+    int packed     = decoder.readByte();
+    // Background color and pixel aspect ratio, browsers ignore both
+    decoder.readByte();
+    if (decoder.readByte() < 0 || decoder.width <= 0 || decoder.height <= 0 ||
+        (long)decoder.width * decoder.height > kMaxCanvasPixels) {
+        return std::nullopt;
+    }
+    if (packed & 0x80) {
+        decoder.globalColorTable =
+            decoder.readColorTable(2 << (packed & 0x07));
+        if (decoder.globalColorTable.empty()) {
+            return std::nullopt;
+        }
+    }
+    decoder.firstBlockPosition = decoder.file.tellg();
+    decoder.canvas.assign((std::size_t)decoder.width * decoder.height * 4, 0);
+    decoder.dirtyRect = {0, 0, decoder.width, decoder.height};
+    return decoder;
+}
+
+auto GifDecoder::decodeNextFrame() -> bool {
+    if (!composeNextFrame()) {
+        // A corrupt frame ends the animation too
+        numFrames = std::max(numFrames, frameIndex + 1);
+        return false;
+    }
+    maybeAddCheckpoint();
+    return true;
+}
+
+auto GifDecoder::composeNextFrame() -> bool {
+    int blockType;
+    while ((blockType = readByte()) >= 0) {
+        if (blockType == 0x3B) {
+            // Trailer
+            return false;
+        }
+        if (blockType == 0x21) {
+            int label = readByte();
+            if (label == 0xF9) {
+                // Graphic control extension: packed fields, delay in
+                // hundredths of a second and transparent color index
+                readByte();
+                int packed       = readByte();
+                delay            = readLittleEndian16() * 10;
+                int transparent  = readByte();
+                disposal         = (packed >> 2) & 0x07;
+                transparentIndex = (packed & 0x01) ? transparent : -1;
+            }
+            if (!readSubBlocks(nullptr)) {
+                return false;
+            }
+            continue;
+        }
+        if (blockType != 0x2C) {
+            return false;
+        }
+
+        SDL_Rect rect;
+        rect.x     = readLittleEndian16();
+        rect.y     = readLittleEndian16();
+        rect.w     = readLittleEndian16();
+        rect.h     = readLittleEndian16();
+        int packed = readByte();
+        // A frame larger than the logical screen is corrupt, and would make
+        // the indices take whatever the header says. A frame that only goes
+        // past its edges is clamped to it below, like browsers do.
+        if (packed < 0 || rect.w > width || rect.h > height) {
+            return false;
+        }
+        std::vector<Uint8> localColorTable;
+        if (packed & 0x80) {
+            localColorTable = readColorTable(2 << (packed & 0x07));
+        }
+        const auto& colorTable =
+            localColorTable.empty() ? globalColorTable : localColorTable;
+        int minCodeSize = readByte();
+        if (minCodeSize < 1 || minCodeSize > 11 ||
+            !readSubBlocks(&compressed)) {
+            return false;
+        }
+        // Corrupt data leaves the rest of the frame transparent, like
+        // browsers do
+        std::size_t numDecoded =
+            decompress(minCodeSize, (std::size_t)rect.w * rect.h);
+
+        if (pendingDisposal == 2 || pendingDisposal == 3) {
+            SDL_UnionRect(&dirtyRect, &pendingRect, &dirtyRect);
+        }
+        disposePreviousFrame();
+        // The part of the frame inside the logical screen
+        SDL_Rect canvasRect{0, 0, width, height};
+        SDL_Rect visibleRect;
+        if (!SDL_IntersectRect(&rect, &canvasRect, &visibleRect)) {
+            visibleRect = {0, 0, 0, 0};
+        }
+        SDL_UnionRect(&dirtyRect, &visibleRect, &dirtyRect);
+        if (disposal == 3) {
+            std::size_t rowBytes = (std::size_t)visibleRect.w * 4;
+            savedPixels.resize(rowBytes * visibleRect.h);
+            for (int y = 0; y < visibleRect.h; ++y) {
+                std::memcpy(savedPixels.data() + y * rowBytes,
+                            getCanvasPixel(visibleRect.x, visibleRect.y + y),
+                            rowBytes);
+            }
+        }
+
+        // Interlaced frames store the rows in 4 passes: every 8th row from
+        // 0, every 8th from 4, every 4th from 2 and every 2nd from 1
+        bool interlaced = (packed & 0x40) != 0;
+        int pass = 0, passRow = 0;
+        constexpr static int kPassStart[4] = {0, 4, 2, 1};
+        constexpr static int kPassStep[4]  = {8, 8, 4, 2};
+        for (int row = 0; row < rect.h; ++row) {
+            int frameRow = row;
+            if (interlaced) {
+                while (kPassStart[pass] + passRow * kPassStep[pass] >= rect.h) {
+                    pass += 1;
+                    passRow = 0;
+                }
+                frameRow = kPassStart[pass] + passRow * kPassStep[pass];
+                passRow += 1;
+            }
+            int canvasY = rect.y + frameRow;
+            if (canvasY < visibleRect.y ||
+                canvasY >= visibleRect.y + visibleRect.h) {
+                continue;
+            }
+            const Uint8* rowIndices =
+                indices.data() + (std::size_t)row * rect.w;
+            for (int x = visibleRect.x - rect.x;
+                 x < visibleRect.x - rect.x + visibleRect.w; ++x) {
+                if ((std::size_t)row * rect.w + x >= numDecoded) {
+                    break;
+                }
+                int index = rowIndices[x];
+                if (index == transparentIndex ||
+                    (std::size_t)index * 3 + 3 > colorTable.size()) {
+                    continue;
+                }
+                Uint8* pixel = getCanvasPixel(rect.x + x, canvasY);
+                pixel[0]     = colorTable[index * 3];
+                pixel[1]     = colorTable[index * 3 + 1];
+                pixel[2]     = colorTable[index * 3 + 2];
+                pixel[3]     = 255;
+            }
+        }
+
+        frameIndex += 1;
+        frameDelay       = delay;
+        pendingDisposal  = disposal;
+        pendingRect      = visibleRect;
+        // The control extension only applies to the next frame
+        disposal         = 0;
+        delay            = 0;
+        transparentIndex = -1;
+        return true;
+    }
+    return false;
+}
+
+void GifDecoder::rewind() {
+    file.clear();
+    file.seekg(firstBlockPosition);
+    std::fill(canvas.begin(), canvas.end(), 0);
+    dirtyRect        = {0, 0, width, height};
+    frameIndex       = -1;
+    frameDelay       = 0;
+    disposal         = 0;
+    delay            = 0;
+    transparentIndex = -1;
+    pendingDisposal  = 0;
+}
+
+auto GifDecoder::seekToFrame(int index) -> bool {
+    if (index < 0) {
+        return false;
+    }
+    dirtyRect = {0, 0, width, height};
+    if (index == frameIndex) {
+        return true;
+    }
+    const Checkpoint* nearest = nullptr;
+    for (const auto& checkpoint : checkpoints) {
+        if (checkpoint.frameIndex > index) {
+            break;
+        }
+        nearest = &checkpoint;
+    }
+    // Going on from the current frame is faster when it is past the nearest
+    // checkpoint
+    bool goOn = frameIndex < index &&
+                (nearest == nullptr || nearest->frameIndex <= frameIndex);
+    if (!goOn) {
+        if (nearest != nullptr) {
+            restoreCheckpoint(*nearest);
+        } else {
+            rewind();
+        }
+    }
+    while (frameIndex < index) {
+        if (!decodeNextFrame()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+auto GifDecoder::getCanvas() const -> const Uint8* {
+    return canvas.data();
+}
+
+auto GifDecoder::takeDirtyRect() -> SDL_Rect {
+    SDL_Rect rect = dirtyRect;
+    dirtyRect     = {0, 0, 0, 0};
+    return rect;
+}
+
+auto GifDecoder::getWidth() const -> int {
+    return width;
+}
+
+auto GifDecoder::getHeight() const -> int {
+    return height;
+}
+
+auto GifDecoder::getFrameIndex() const -> int {
+    return frameIndex;
+}
+
+auto GifDecoder::getFrameDelay() const -> int {
+    return frameDelay;
+}
+
+auto GifDecoder::getNumFrames() const -> int {
+    return numFrames;
+}
+
+auto GifDecoder::getMemory() const -> long {
+    return (long)(canvas.capacity() + savedPixels.capacity() +
+                  compressed.capacity() + indices.capacity()) +
+           checkpointBytes;
+}
+
+void GifDecoder::maybeAddCheckpoint() {
+    // The frames are decoded in order from the last checkpoint, so the new
+    // ones always go at the end
+    if (frameIndex % checkpointInterval != 0 ||
+        (!checkpoints.empty() && checkpoints.back().frameIndex >= frameIndex)) {
+        return;
+    }
+    checkpoints.push_back({frameIndex, file.tellg(), frameDelay, canvas,
+                           pendingDisposal, pendingRect, savedPixels});
+    checkpointBytes += (long)(canvas.size() + savedPixels.size());
+
+    // Keeps every other checkpoint, which doubles the frames composed by a
+    // seek instead of the memory
+    while (checkpointBytes > kMaxCheckpointBytes && checkpoints.size() > 1) {
+        checkpointInterval *= 2;
+        checkpoints.erase(
+            std::remove_if(checkpoints.begin(), checkpoints.end(),
+                           [&](const Checkpoint& checkpoint) {
+                               return checkpoint.frameIndex %
+                                          checkpointInterval !=
+                                      0;
+                           }),
+            checkpoints.end());
+        checkpointBytes = 0;
+        for (const auto& checkpoint : checkpoints) {
+            checkpointBytes += (long)(checkpoint.canvas.size() +
+                                      checkpoint.savedPixels.size());
+        }
+    }
+}
+
+void GifDecoder::restoreCheckpoint(const Checkpoint& checkpoint) {
+    file.clear();
+    file.seekg(checkpoint.position);
+    frameIndex       = checkpoint.frameIndex;
+    frameDelay       = checkpoint.frameDelay;
+    canvas           = checkpoint.canvas;
+    pendingDisposal  = checkpoint.pendingDisposal;
+    pendingRect      = checkpoint.pendingRect;
+    savedPixels      = checkpoint.savedPixels;
+    disposal         = 0;
+    delay            = 0;
+    transparentIndex = -1;
+}
+
+auto GifDecoder::readByte() -> int {
+    int byte = file.get();
+    return byte == EOF ? -1 : byte;
+}
+
+auto GifDecoder::readLittleEndian16() -> int {
+    int low  = readByte();
+    int high = readByte();
+    return (low < 0 || high < 0) ? 0 : low | (high << 8);
+}
+
+auto GifDecoder::readColorTable(int size) -> std::vector<Uint8> {
+    std::vector<Uint8> table((std::size_t)size * 3);
+    if (!file.read((char*)table.data(), (std::streamsize)table.size())) {
+        return {};
+    }
+    return table;
+}
+
+auto GifDecoder::readSubBlocks(std::vector<Uint8>* data) -> bool {
+    if (data != nullptr) {
+        data->clear();
+    }
+    int length;
+    while ((length = readByte()) > 0) {
+        if (data == nullptr) {
+            file.seekg(length, std::ios::cur);
+            continue;
+        }
+        std::size_t offset = data->size();
+        data->resize(offset + length);
+        if (!file.read((char*)data->data() + offset, length)) {
+            return false;
+        }
+    }
+    return length == 0;
+}
+
+auto GifDecoder::decompress(int minCodeSize, std::size_t numPixels)
+    -> std::size_t {
+    constexpr static int kMaxCodes = 4096;
+    indices.resize(numPixels);
+    const int clearCode = 1 << minCodeSize;
+    const int endCode   = clearCode + 1;
+    int codeSize        = minCodeSize + 1;
+    int nextCode        = endCode + 1;
+
+    // Every code is a previous code plus one byte, so a code is at most
+    // kMaxCodes bytes long
+    std::array<uint16_t, kMaxCodes> prefix;
+    std::array<Uint8, kMaxCodes> suffix;
+    std::array<Uint8, kMaxCodes> stack;
+    for (int i = 0; i < clearCode; ++i) {
+        suffix[i] = (Uint8)i;
+    }
+
+    std::size_t bitPosition = 0;
+    const std::size_t numBits = compressed.size() * 8;
+    const auto readCode = [&]() -> int {
+        if (bitPosition + codeSize > numBits) {
+            return -1;
+        }
+        int code = 0;
+        for (int i = 0; i < codeSize; ++i, ++bitPosition) {
+            code |= ((compressed[bitPosition >> 3] >> (bitPosition & 7)) & 1)
+                    << i;
+        }
+        return code;
+    };
+
+    std::size_t numDecoded = 0;
+    int previous           = -1;
+    Uint8 firstByte        = 0;
+    while (numDecoded < numPixels) {
+        int code = readCode();
+        if (code < 0 || code == endCode) {
+            break;
+        }
+        if (code == clearCode) {
+            codeSize = minCodeSize + 1;
+            nextCode = endCode + 1;
+            previous = -1;
+            continue;
+        }
+        if (previous < 0) {
+            if (code >= clearCode) {
+                break;
+            }
+            indices[numDecoded++] = (Uint8)code;
+            previous              = code;
+            firstByte             = (Uint8)code;
+            continue;
+        }
+
+        // The bytes of the code are found backwards
+        int current        = code;
+        std::size_t length = 0;
+        if (code >= nextCode) {
+            // Only the code being defined can be used before it exists: the
+            // previous string followed by its own first byte
+            if (code > nextCode) {
+                break;
+            }
+            stack[length++] = firstByte;
+            current         = previous;
+        }
+        while (current > endCode) {
+            stack[length++] = suffix[current];
+            current         = prefix[current];
+        }
+        firstByte       = (Uint8)current;
+        stack[length++] = firstByte;
+        while (length > 0 && numDecoded < numPixels) {
+            indices[numDecoded++] = stack[--length];
+        }
+
+        if (nextCode < kMaxCodes) {
+            prefix[nextCode] = (uint16_t)previous;
+            suffix[nextCode] = firstByte;
+            nextCode += 1;
+            if (nextCode == (1 << codeSize) && codeSize < 12) {
+                codeSize += 1;
+            }
+        }
+        previous = code;
+    }
+    return numDecoded;
+}
+
+void GifDecoder::disposePreviousFrame() {
+    const auto& rect = pendingRect;
+    if (pendingDisposal == 2) {
+        // Restore to background, which browsers treat as transparent
+        for (int y = rect.y; y < rect.y + rect.h; ++y) {
+            std::memset(getCanvasPixel(rect.x, y), 0, (std::size_t)rect.w * 4);
+        }
+    } else if (pendingDisposal == 3) {
+        // Restore to the canvas before the previous frame
+        std::size_t rowBytes = (std::size_t)rect.w * 4;
+        for (int y = 0; y < rect.h; ++y) {
+            std::memcpy(getCanvasPixel(rect.x, rect.y + y),
+                        savedPixels.data() + y * rowBytes, rowBytes);
+        }
+    }
+    pendingDisposal = 0;
+}
+
+auto GifDecoder::getCanvasPixel(int x, int y) -> Uint8* {
+    return canvas.data() + ((std::size_t)y * width + x) * 4;
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <climits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "sdlUtils.hpp"
+#include "typesDefinition.hpp"
+
+// Draws text from a texture with the glyphs of the font, rendered with
+// SDL_ttf the first time each one is used. The texts are queued as quads and
+// drawn with one SDL_RenderGeometry call, so the cost of a frame depends on
+// the number of characters drawn, not on how many of the strings changed.
+//
+// The glyphs are packed in rows of a single page. Characters outside the
+// Basic Multilingual Plane, or that do not fit once the page is full, are
+// drawn as '?'. Kerning is not applied.
+//
+// It must only be used from the main thread, with the same font always.
+class GlyphAtlas {
+  public:
+    // Width in pixels of the UTF-8 text
+    auto measure(const SdlRenderer& renderer, TTF_Font* font,
+                 const std::string& text) -> int;
+
+    // Queues the UTF-8 text with its top left corner at x, y. If it is
+    // wider than maxWidth, it is cut and ends with "...". Returns its width.
+    auto addText(const SdlRenderer& renderer, TTF_Font* font,
+                 const std::string& text, int x, int y, SDL_Color color,
+                 int maxWidth = INT_MAX) -> int;
+    void drawBatch(const SdlRenderer& renderer);
+
+    auto getLineHeight(TTF_Font* font) const -> int;
+
+  private:
+    struct Glyph {
+        // Empty if the glyph has no pixels, like the space
+        SDL_Rect rect;
+        int advance;
+    };
+
+    auto getGlyph(const SdlRenderer& renderer, TTF_Font* font,
+                  Uint32 codepoint) -> const Glyph&;
+    auto createGlyph(const SdlRenderer& renderer, TTF_Font* font,
+                     Uint16 character) -> std::optional<Glyph>;
+    auto createPage(const SdlRenderer& renderer) -> bool;
+    void addQuad(const SDL_Rect& source, int x, int y, SDL_Color color);
+    // Decodes the character at position and moves it to the next one
+    static auto decodeUtf8(const std::string& text, std::size_t& position)
+        -> Uint32;
+
+    // Transparent gap between glyphs, for the bilinear filter
+    constexpr static int kPadding     = 1;
+    constexpr static int kMaxPageSize = 1024;
+    constexpr static Uint32 kReplacementCharacter = '?';
+
+    std::optional<SdlTexture> page;
+    int pageSize{0};
+    int rowX{0};
+    int rowY{0};
+    int rowHeight{0};
+    std::unordered_map<Uint32, Glyph> glyphs;
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
+};
+
+//**************************************************************
+//********************* Implementation *************************
+//**************************************************************
+
+auto GlyphAtlas::measure(const SdlRenderer& renderer, TTF_Font* font,
+                         const std::string& text) -> int {
+    int width = 0;
+    for (std::size_t position = 0; position < text.size();) {
+        width += getGlyph(renderer, font, decodeUtf8(text, position)).advance;
+    }
+    return width;
+}
+
+auto GlyphAtlas::addText(const SdlRenderer& renderer, TTF_Font* font,
+                         const std::string& text, int x, int y,
+                         SDL_Color color, int maxWidth) -> int {
+    int ellipsisWidth = 0;
+    bool cut          = measure(renderer, font, text) > maxWidth;
+    if (cut) {
+        ellipsisWidth = 3 * getGlyph(renderer, font, '.').advance;
+    }
+    int penX = x;
+    for (std::size_t position = 0; position < text.size();) {
+        Uint32 codepoint  = decodeUtf8(text, position);
+        const auto& glyph = getGlyph(renderer, font, codepoint);
+        if (cut && penX - x + glyph.advance + ellipsisWidth > maxWidth) {
+            break;
+        }
+        if (glyph.rect.w > 0) {
+            addQuad(glyph.rect, penX, y, color);
+        }
+        penX += glyph.advance;
+    }
+    if (cut) {
+        const auto& dot = getGlyph(renderer, font, '.');
+        for (int i = 0; i < 3; ++i) {
+            if (dot.rect.w > 0) {
+                addQuad(dot.rect, penX, y, color);
+            }
+            penX += dot.advance;
+        }
+    }
+    return penX - x;
+}
+
+void GlyphAtlas::drawBatch(const SdlRenderer& renderer) {
+    if (page && !indices.empty()) {
+        SDL_RenderGeometry(renderer.get(), page.value().get(), vertices.data(),
+                           (int)vertices.size(), indices.data(),
+                           (int)indices.size());
+    }
+    // The capacity is kept, so the next frames do not allocate
+    vertices.clear();
+    indices.clear();
+}
+
+auto GlyphAtlas::getLineHeight(TTF_Font* font) const -> int {
+    return TTF_FontHeight(font);
+}
+
+auto GlyphAtlas::getGlyph(const SdlRenderer& renderer, TTF_Font* font,
+                          Uint32 codepoint) -> const Glyph& {
+    auto it = glyphs.find(codepoint);
+    if (it != glyphs.end()) {
+        return it->second;
+    }
+    std::optional<Glyph> glyph;
+    if (codepoint <= 0xFFFF) {
+        glyph = createGlyph(renderer, font, (Uint16)codepoint);
+    }
+    if (!glyph && codepoint != kReplacementCharacter) {
+        glyph = getGlyph(renderer, font, kReplacementCharacter);
+    }
+    // Not even the replacement fits, it only takes space
+    return glyphs.emplace(codepoint, glyph.value_or(Glyph{{0, 0, 0, 0}, 0}))
+        .first->second;
+}
+
+auto GlyphAtlas::createGlyph(const SdlRenderer& renderer, TTF_Font* font,
+                             Uint16 character) -> std::optional<Glyph> {
+    int minX, maxX, minY, maxY, advance;
+    if (TTF_GlyphMetrics(font, character, &minX, &maxX, &minY, &maxY,
+                         &advance) != 0) {
+        return std::nullopt;
+    }
+    if (maxX <= minX || maxY <= minY) {
+        return Glyph{{0, 0, 0, 0}, advance};
+    }
+    // As wide as the advance and as tall as the line, so it is drawn at the
+    // pen position like TTF_RenderText_Blended would draw it
+    SDL_Surface* rendered =
+        TTF_RenderGlyph_Blended(font, character, {255, 255, 255});
+    if (rendered == nullptr) {
+        return std::nullopt;
+    }
+    auto surface = createSurface(
+        SDL_ConvertSurfaceFormat(rendered, SDL_PIXELFORMAT_RGBA32, 0));
+    SDL_FreeSurface(rendered);
+    if (!surface || (!page && !createPage(renderer))) {
+        return std::nullopt;
+    }
+
+    int width  = surface->w;
+    int height = surface->h;
+    if (rowX + width > pageSize) {
+        rowY += rowHeight + kPadding;
+        rowX      = 0;
+        rowHeight = 0;
+    }
+    if (width > pageSize || rowY + height > pageSize) {
+        return std::nullopt;
+    }
+    SDL_Rect rect{rowX, rowY, width, height};
+    if (SDL_UpdateTexture(page.value().get(), &rect, surface->pixels,
+                          surface->pitch) != 0) {
+        return std::nullopt;
+    }
+    rowX += width + kPadding;
+    rowHeight = std::max(rowHeight, height);
+    return Glyph{rect, advance};
+}
+
+auto GlyphAtlas::createPage(const SdlRenderer& renderer) -> bool {
+    pageSize = std::min(kMaxPageSize, getMaxTextureSize(renderer));
+    SDL_Texture* texture =
+        SDL_CreateTexture(renderer.get(), SDL_PIXELFORMAT_RGBA32,
+                          SDL_TEXTUREACCESS_STATIC, pageSize, pageSize);
+    if (texture == nullptr) {
+        return false;
+    }
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    // The padding between the glyphs has to be transparent
+    std::vector<Uint8> transparent((std::size_t)pageSize * pageSize * 4, 0);
+    SDL_UpdateTexture(texture, nullptr, transparent.data(), pageSize * 4);
+    page = createTexture(texture);
+    return true;
+}
+
+void GlyphAtlas::addQuad(const SDL_Rect& source, int x, int y,
+                         SDL_Color color) {
+    auto firstVertex     = (int)vertices.size();
+    const auto addVertex = [&](int vertexX, int vertexY, int u, int v) {
+        vertices.push_back({{(float)vertexX, (float)vertexY},
+                            color,
+                            {(float)u / pageSize, (float)v / pageSize}});
+    };
+    addVertex(x, y, source.x, source.y);
+    addVertex(x + source.w, y, source.x + source.w, source.y);
+    addVertex(x + source.w, y + source.h, source.x + source.w,
+              source.y + source.h);
+    addVertex(x, y + source.h, source.x, source.y + source.h);
+    for (int offset : {0, 1, 2, 0, 2, 3}) {
+        indices.push_back(firstVertex + offset);
+    }
+}
+
+auto GlyphAtlas::decodeUtf8(const std::string& text, std::size_t& position)
+    -> Uint32 {
+    auto byte = (Uint8)text[position++];
+    int length;
+    Uint32 codepoint;
+    if (byte < 0x80) {
+        return byte;
+    } else if ((byte & 0xE0) == 0xC0) {
+        length    = 1;
+        codepoint = byte & 0x1F;
+    } else if ((byte & 0xF0) == 0xE0) {
+        length    = 2;
+        codepoint = byte & 0x0F;
+    } else if ((byte & 0xF8) == 0xF0) {
+        length    = 3;
+        codepoint = byte & 0x07;
+    } else {
+        return kReplacementCharacter;
+    }
+    for (int i = 0; i < length; ++i) {
+        if (position >= text.size() || ((Uint8)text[position] & 0xC0) != 0x80) {
+            return kReplacementCharacter;
+        }
+        codepoint = (codepoint << 6) | ((Uint8)text[position++] & 0x3F);
+    }
+    return codepoint;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// Least recently used order of the full images loaded in the ImageHeaders,
+// with their decoded size in bytes. The textures stay in the ImageHeaders,
+// the cache only decides which ones are unloaded when their total size goes
+// over the budget.
+class ImageCache {
+  public:
+    ImageCache(long budget) : budget(budget) {
+    }
+
+    // Marks the image as the most recently used one
+    void touch(std::size_t index, long bytes);
+    void erase(std::size_t index);
+    auto contains(std::size_t index) const -> bool;
+
+    // Removes and returns the least recently used images until the rest fit
+    // in the budget. The protected ones are never evicted, even if they do
+    // not fit.
+    auto evict(const std::function<bool(std::size_t)>& isProtected)
+        -> std::vector<std::size_t>;
+
+    auto totalBytes() const -> long;
+    // Applied by the next evict
+    void setBudget(long newBudget);
+
+  private:
+    struct Entry {
+        std::size_t index;
+        long bytes;
+    };
+
+    // The most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<std::size_t, std::list<Entry>::iterator> positions;
+    long budget;
+    long bytes{0};
+};
+
+//**************************************************************
+//********************* Implementation *************************
+//**************************************************************
+
+void ImageCache::touch(std::size_t index, long entryBytes) {
+    auto it = positions.find(index);
+    if (it != positions.end()) {
+        bytes -= it->second->bytes;
+        entries.erase(it->second);
+    }
+    entries.push_front({index, entryBytes});
+    positions[index] = entries.begin();
+    bytes += entryBytes;
+}
+
+void ImageCache::erase(std::size_t index) {
+    auto it = positions.find(index);
+    if (it == positions.end()) {
+        return;
+    }
+    bytes -= it->second->bytes;
+    entries.erase(it->second);
+    positions.erase(it);
+}
+
+auto ImageCache::contains(std::size_t index) const -> bool {
+    return positions.find(index) != positions.end();
+}
+
+auto ImageCache::evict(const std::function<bool(std::size_t)>& isProtected)
+    -> std::vector<std::size_t> {
+    std::vector<std::size_t> evicted;
+    auto it = entries.end();
+    while (bytes > budget && it != entries.begin()) {
+        --it;
+        if (isProtected(it->index)) {
+            continue;
+        }
+        evicted.push_back(it->index);
+        bytes -= it->bytes;
+        positions.erase(it->index);
+        it = entries.erase(it);
+    }
+    return evicted;
+}
+
+auto ImageCache::totalBytes() const -> long {
+    return bytes;
+}
+
+void ImageCache::setBudget(long newBudget) {
+    budget = newBudget;
+}
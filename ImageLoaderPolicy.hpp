@@ -1,23 +1,196 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <set>
+
+#include "ImageCache.hpp"
+#include "MemoryAccounting.hpp"
+#include "ThumbnailAtlas.hpp"
+#include "ThumbnailStore.hpp"
+#include "WorkerPool.hpp"
+#include "freedesktopThumbnails.hpp"
+#include "imagePyramid.hpp"
+#include "jpegUtils.hpp"
 #include "sdlUtils.hpp"
+#include "thumbnailScheduling.hpp"
+#include "tiledImage.hpp"
 #include "typesDefinition.hpp"
 
 class ImageLoaderPolicy {
   public:
-    ImageLoaderPolicy(int numImages) : loadedThumbnails(numImages, false) {
+    ImageLoaderPolicy(int numImages, const LoaderSettings& loaderSettings)
+        : loadedThumbnails(numImages, false),
+          imageCache(loaderSettings.imageCacheSize),
+          memoryAccounting(loaderSettings.memoryBudget),
+          imageCacheSize(loaderSettings.imageCacheSize),
+          frameBudget(loaderSettings.frameBudget),
+          prefetchImages(loaderSettings.prefetchImages),
+          writeSharedThumbnails(loaderSettings.writeSharedThumbnails) {
+        if (loaderSettings.thumbnailStoreSize > 0) {
+            thumbnailStore = std::make_unique<ThumbnailStore>(
+                loaderSettings.thumbnailStoreSize);
+        }
+        if (loaderSettings.numThreads > 0) {
+            workerPool = std::make_unique<WorkerPool>(loaderSettings.numThreads);
+        }
     }
 
     void loadInGrid(SdlContext& sdlContext);
     void loadInViewer(SdlContext& sdlContext);
-    void loadNext(SdlContext& sdlContext);
+    // Returns true if it changed what is drawn, or if it has work left for
+    // the main thread, so the main loop does not wait for events. The
+    // workers wake it up with wakeUpMainLoop when they have results.
+    auto loadNext(SdlContext& sdlContext) -> bool;
+
+    // Thumbnails decoded per second during the last measured second. It is 0
+    // when there is nothing being loaded.
+    auto thumbnailsPerSecond() const -> float;
+    // Average of thumbnails loaded per frame in the same second
+    auto thumbnailsPerFrame() const -> float;
+
+    auto getThumbnailAtlas() -> ThumbnailAtlas&;
+    auto getMemoryAccounting() const -> const MemoryAccounting&;
 
   private:
+    using CancelFlag = WorkerPool::CancelFlag;
+
+    struct DecodedThumbnail {
+        std::size_t index;
+        int thumbnailSize;
+        std::optional<SdlSurface> surface;
+        int width;
+        int height;
+        long memory;
+        CancelFlag cancelled{};
+    };
+
+    // Sizes the thumbnails are decoded at. The grid draws them scaled from
+    // the smallest level that is at least style.thumbnailSize, so zooming
+    // only decodes again when it crosses a level.
+    constexpr static std::array<int, 4> kThumbnailLevels{64, 128, 256, 512};
+    static auto getThumbnailLevel(int thumbnailSize) -> int;
+
+    // Thread safe. Fills the surface and the original dimensions from the
+    // thumbnail computed by other programs or the preview embedded in the
+    // JPEG, which need no decoding. jpegHeader is set if the file is a JPEG.
+    static auto loadPreviewThumbnail(const std::string& filename,
+                                     DecodedThumbnail& decoded,
+                                     std::optional<JpegHeader>& jpegHeader)
+        -> bool;
+    // Thread safe, called from the workers. It gives up as soon as
+    // cancelled is set, even in the middle of decoding the full image.
+    static auto decodeThumbnail(std::size_t index, const std::string& filename,
+                                int thumbnailSize, bool writeSharedThumbnail,
+                                const std::atomic<bool>* cancelled = nullptr)
+        -> DecodedThumbnail;
+
+    void updateScrollDirection(int rowsScroll);
+    auto rankPendingThumbnails(SdlContext& sdlContext, std::size_t first,
+                               std::size_t last) -> std::vector<std::size_t>;
+    void cancelThumbnails(std::size_t first, std::size_t last);
+    void submitThumbnail(SdlContext& sdlContext, std::size_t index);
+    void loadThumbnail(SdlContext& sdlContext, std::size_t index);
+
+    void updateThumbnailLevel(SdlContext& sdlContext);
+    void setThumbnail(SdlContext& sdlContext, std::size_t index,
+                      const AtlasRegion& region, int level);
+    void releaseThumbnail(SdlContext& sdlContext, std::size_t index);
+    // The thumbnails take the memory of the atlas pages, not of their regions
+    void updateThumbnailMemory();
+    void readStoredDimensions(SdlContext& sdlContext);
+    void uploadStoredThumbnails(SdlContext& sdlContext, std::size_t first,
+                                std::size_t last);
+    void uploadThumbnail(SdlContext& sdlContext, DecodedThumbnail& decoded);
+    void uploadDecodedThumbnails(SdlContext& sdlContext);
+    void updateThroughput(int loaded, bool endOfFrame = false);
+
+    struct DecodedImage {
+        std::size_t index;
+        std::optional<SdlSurface> surface;
+        long memory;
+        CancelFlag cancelled;
+        // Only for the images bigger than the maximum texture size
+        std::optional<SdlSurface> overview{};
+    };
+
+    struct DecodedPyramid {
+        std::size_t index;
+        // Empty if it was cancelled
+        std::vector<SdlSurface> levels;
+        CancelFlag cancelled;
+    };
+
+    // Size of the decoded image, tiled image or animation frames of the
+    // ImageHeader
+    static auto getDecodedSize(const ImageHeader& imageHeader) -> long;
+
+    void updateNavigationDirection(int currentImage);
+    // Images to keep loaded in the image view, the most urgent first
+    auto getWantedImages(SdlContext& sdlContext) -> std::vector<std::size_t>;
+    void submitImage(SdlContext& sdlContext, std::size_t index);
+    // The cancelled images are dropped, unless they are wanted again
+    void uploadDecodedImages(SdlContext& sdlContext,
+                             const std::function<bool(std::size_t)>& isWanted);
+    // For an image with a pyramid that is drawn at full resolution again
+    void uploadFullResolution(SdlContext& sdlContext, DecodedImage& decoded);
+    // Downscales the levels of an image already uploaded in the background
+    void submitPyramid(std::size_t index, SdlSurface image);
+    void uploadDecodedPyramids(SdlContext& sdlContext);
+    // Marks the image as the most recently used and accounts its size
+    void touchImage(SdlContext& sdlContext, std::size_t index);
+    void unloadImage(SdlContext& sdlContext, std::size_t index);
+
+    // Evicts the cached images that are not on screen, the least recently
+    // used first, and then the thumbnails out of the loaded window, the
+    // farthest from the cursor first, until everything fits in the budget
+    void enforceMemoryBudget(SdlContext& sdlContext);
+
     std::vector<bool> loadedThumbnails;
-    std::unordered_set<std::size_t> loadedImages;
-    int lastCurrentImage{-1};
-    int lastLoadedThumbnail{-1};
-    int lastLoadedImage{-1};
+    // The full images loaded, including the ones kept after leaving the view
+    ImageCache imageCache;
+    MemoryAccounting memoryAccounting;
+    long imageCacheSize;
+    // Thumbnails that are never released to fit in the memory budget
+    std::size_t thumbnailWindowFirst{0};
+    std::size_t thumbnailWindowLast{0};
+    // Images that hold a thumbnail, so the ones out of the window are found
+    // without going through the whole catalog
+    std::set<std::size_t> thumbnailIndices;
+    std::unordered_map<std::size_t, CancelFlag> imagesInFlight;
+    std::unordered_map<std::size_t, CancelFlag> pyramidsInFlight;
+    int lastCurrentImage{0};
+    // Images shown with their thumbnail for a frame before loading them
+    std::unordered_set<std::size_t> deferredImages;
+    // 1 when moving to the next images, -1 when moving to the previous ones
+    int navigationDirection{1};
+    int prefetchImages;
+
+    int thumbnailLevel{0};
+    int lastRowsScroll{0};
+    // 1 when scrolling down, -1 when scrolling up
+    int scrollDirection{1};
+    ThumbnailsInFlight thumbnailsInFlight;
+    int loadedInWindow{0};
+    int framesInWindow{0};
+    Uint32 windowStartTime{0};
+    float throughput{0.};
+    float throughputPerFrame{0.};
+    int frameBudget;
+    bool storedDimensionsRead{false};
+    bool writeSharedThumbnails;
+    // Set by loadNext when a frame has to be drawn again
+    bool changed{false};
+    bool hasPendingWork{false};
+
+    ThumbnailAtlas thumbnailAtlas;
+    std::unique_ptr<ThumbnailStore> thumbnailStore;
+    ResultQueue<DecodedThumbnail> decodedThumbnails;
+    ResultQueue<DecodedImage> decodedImages;
+    ResultQueue<DecodedPyramid> decodedPyramids;
+    // Declared last so the workers are joined before the queue is destroyed
+    std::unique_ptr<WorkerPool> workerPool;
 };
 
 //**************************************************************
@@ -25,83 +198,503 @@ class ImageLoaderPolicy {
 //**************************************************************
 
 void ImageLoaderPolicy::loadInGrid(SdlContext& sdlContext) {
-    int numColumns  = sdlContext.gridImagesState.numColumns;
-    int numRows     = sdlContext.gridImagesState.numRows;
-    int imageRow    = sdlContext.currentImage / numColumns;
-    int imageColumn = sdlContext.currentImage % numColumns;
-    int vscroll     = sdlContext.gridImagesState.rowsScroll;
+    const auto& gridImagesState = sdlContext.gridImagesState;
+    int numColumns              = std::max(gridImagesState.numColumns, 1);
+    int numRows                 = std::max(gridImagesState.numRows, 1);
+    int rowsScroll              = gridImagesState.rowsScroll;
+    updateScrollDirection(rowsScroll);
+
+    const auto getIndex = [&](int row) -> std::size_t {
+        return std::clamp(row * numColumns, 0, (int)loadedThumbnails.size());
+    };
+
+    // Besides the visible rows, one screen ahead in the scroll direction and
+    // half a screen behind are loaded. Anything farther is cancelled.
+    int rowsAhead  = numRows;
+    int rowsBehind = std::max(numRows / 2, 1);
+    int firstRow   = rowsScroll - (scrollDirection > 0 ? rowsBehind : rowsAhead);
+    int lastRow    = rowsScroll + numRows + (scrollDirection > 0 ? rowsAhead
+                                                                 : rowsBehind);
+    std::size_t first = getIndex(firstRow);
+    std::size_t last  = getIndex(lastRow);
+    cancelThumbnails(first, last);
+    thumbnailWindowFirst = first;
+    thumbnailWindowLast  = last;
 
-    auto& v = loadedThumbnails;
+    // Stored thumbnails need no decoding, so all the visible ones are
+    // uploaded at once
+    if (thumbnailStore) {
+        uploadStoredThumbnails(sdlContext, getIndex(rowsScroll),
+                               getIndex(rowsScroll + numRows));
+    }
 
-    const auto getFrontierIterators = [&]() {
-        auto firstIt = v.begin() + vscroll * numColumns;
-        auto lastIt  = firstIt + numColumns * numRows;
-        if (numColumns * numRows + vscroll * numColumns >= v.size()) {
-            lastIt = v.end();
+    if (!workerPool) {
+        // As many as fit in the frame budget, but always one so a slow image
+        // does not stall the loading
+        Uint64 startTime = SDL_GetPerformanceCounter();
+        Uint64 budget =
+            SDL_GetPerformanceFrequency() * (Uint64)frameBudget / 1000;
+        auto pending = rankPendingThumbnails(sdlContext, first, last);
+        std::size_t loaded = 0;
+        for (auto index : pending) {
+            loadThumbnail(sdlContext, index);
+            loaded += 1;
+            if (SDL_GetPerformanceCounter() - startTime >= budget) {
+                break;
+            }
         }
-        if (vscroll * numColumns >= v.size()) {
-            firstIt = v.end();
+        hasPendingWork = loaded < pending.size();
+        return;
+    }
+
+    // Keep every worker busy with one job plus one queued, so the queue
+    // never holds work that is far from the current view
+    const std::size_t maxInFlight = 2 * workerPool->numThreads();
+    if (thumbnailsInFlight.size() >= maxInFlight) {
+        return;
+    }
+    for (auto index : rankPendingThumbnails(sdlContext, first, last)) {
+        if (thumbnailsInFlight.size() >= maxInFlight) {
+            break;
         }
-        auto rFirstIt = std::reverse_iterator<decltype(firstIt)>(firstIt);
-        return std::make_tuple(rFirstIt, lastIt);
-    };
+        submitThumbnail(sdlContext, index);
+    }
+}
 
-    const auto isThumnailNotLoaded = [](const auto& value) { return !value; };
+void ImageLoaderPolicy::updateScrollDirection(int rowsScroll) {
+    if (rowsScroll > lastRowsScroll) {
+        scrollDirection = 1;
+    } else if (rowsScroll < lastRowsScroll) {
+        scrollDirection = -1;
+    }
+    lastRowsScroll = rowsScroll;
+}
+
+auto ImageLoaderPolicy::rankPendingThumbnails(SdlContext& sdlContext,
+                                              std::size_t first,
+                                              std::size_t last)
+    -> std::vector<std::size_t> {
+    std::vector<std::size_t> pending;
+    for (std::size_t index = first; index < last; ++index) {
+        if (!loadedThumbnails[index]) {
+            pending.push_back(index);
+        }
+    }
+    sortThumbnailsToLoad(pending, sdlContext.gridImagesState, scrollDirection,
+                         sdlContext.currentImage);
+    return pending;
+}
 
-    const auto findUnloadedImageIterator = [&](auto rFirstIt, auto lastIt) {
-        int currentLoadingPos = sdlContext.currentImage;
-        if (sdlContext.currentImage == lastCurrentImage) {
-            currentLoadingPos = lastLoadedThumbnail;
-            lastCurrentImage  = sdlContext.currentImage;
+void ImageLoaderPolicy::cancelThumbnails(std::size_t first, std::size_t last) {
+    // The pool drops the queued jobs, the running ones stop before decoding
+    // the full image. Their thumbnails are pending again.
+    for (auto it = thumbnailsInFlight.begin(); it != thumbnailsInFlight.end();) {
+        if (it->first >= first && it->first < last) {
+            ++it;
+            continue;
         }
+        it->second->store(true);
+        loadedThumbnails[it->first] = false;
+        it = thumbnailsInFlight.erase(it);
+    }
+}
 
-        // Forward loading from current image
-        auto it = std::find_if(v.begin() + currentLoadingPos, lastIt,
-                               isThumnailNotLoaded);
+void ImageLoaderPolicy::submitThumbnail(SdlContext& sdlContext,
+                                        std::size_t index) {
+    auto cancelled = std::make_shared<std::atomic<bool>>(false);
+    loadedThumbnails[index]   = true;
+    thumbnailsInFlight[index] = cancelled;
+    workerPool->submit(
+        [this, index, filename = sdlContext.imagesVector[index].fileAdress,
+         thumbnailSize = thumbnailLevel, writeShared = writeSharedThumbnails,
+         cancelled]() {
+            DecodedThumbnail decoded{index, thumbnailSize, std::nullopt, 0, 0,
+                                     0};
+            if (!cancelled->load()) {
+                decoded = decodeThumbnail(index, filename, thumbnailSize,
+                                          writeShared, cancelled.get());
+            }
+            decoded.cancelled = cancelled;
+            decodedThumbnails.push(std::move(decoded));
+            wakeUpMainLoop();
+        },
+        cancelled);
+}
+
+void ImageLoaderPolicy::loadThumbnail(SdlContext& sdlContext,
+                                      std::size_t index) {
+    int width, height;
+    long memory;
+    auto thumbnailSize      = thumbnailLevel;
+    loadedThumbnails[index] = true;
+    updateThroughput(1);
+
+    const auto& filename = sdlContext.imagesVector[index].fileAdress;
+    if (sdlContext.loaderSettings.thumbnailScaling == ThumbnailScaling::Cpu) {
+        // Goes through a surface, so it can be saved in the store
+        auto decoded = decodeThumbnail(index, filename, thumbnailSize,
+                                       writeSharedThumbnails);
+        uploadThumbnail(sdlContext, decoded);
+        return;
+    }
 
-        // Reverse loading from current image
-        if (it == lastIt) {
-            auto rit = std::find_if(std::rbegin(v) +
-                                        (v.size() - currentLoadingPos - 1),
-                                    rFirstIt, isThumnailNotLoaded);
-            it       = (rit + 1).base();
+    // Only the images without a preview are decoded and scaled in the GPU
+    DecodedThumbnail decoded{index, thumbnailSize, std::nullopt, 0, 0, 0};
+    std::optional<JpegHeader> jpegHeader;
+    if (loadPreviewThumbnail(filename, decoded, jpegHeader)) {
+        std::error_code error;
+        auto fileSize  = std::filesystem::file_size(filename, error);
+        decoded.memory = error ? 0 : (long)fileSize;
+        uploadThumbnail(sdlContext, decoded);
+        return;
+    }
+    auto thumbnail =
+        createThumbnailWithSize(sdlContext.renderer, filename, thumbnailSize,
+                                thumbnailSize, width, height, memory);
+    if (!thumbnail) {
+        return;
+    }
+    auto region =
+        thumbnailAtlas.insert(sdlContext.renderer, thumbnail.value().get());
+    if (!region) {
+        return;
+    }
+
+    setThumbnail(sdlContext, index, region.value(), thumbnailSize);
+    sdlContext.imagesVector[index].width  = width;
+    sdlContext.imagesVector[index].height = height;
+    sdlContext.imagesVector[index].memory = memory;
+    if (thumbnailStore) {
+        // Read back from the page, the GPU scaled it with no surface
+        auto pixels =
+            thumbnailAtlas.readRegion(sdlContext.renderer, region.value());
+        if (pixels) {
+            thumbnailStore->insert(filename, thumbnailSize,
+                                   pixels.value().get(), width, height);
         }
-        return it;
-    };
+    }
+}
+
+auto ImageLoaderPolicy::loadPreviewThumbnail(
+    const std::string& filename, DecodedThumbnail& decoded,
+    std::optional<JpegHeader>& jpegHeader) -> bool {
+    int thumbnailSize = decoded.thumbnailSize;
+
+    // Thumbnails already computed by other programs
+    auto shared = loadSharedThumbnail(filename, thumbnailSize);
+    if (shared) {
+        auto& surface   = shared.value().surface;
+        bool knownSize  = shared.value().originalWidth > 0 &&
+                         shared.value().originalHeight > 0;
+        decoded.width   = knownSize ? shared.value().originalWidth : surface->w;
+        decoded.height  = knownSize ? shared.value().originalHeight : surface->h;
+        decoded.surface = createThumbnailSurface(surface.get(), thumbnailSize,
+                                                 thumbnailSize);
+        return decoded.surface.has_value();
+    }
+
+    // Camera JPEGs usually embed a small preview, which avoids decoding the
+    // main image when the thumbnails are small enough
+    jpegHeader = readJpegHeader(filename);
+    if (jpegHeader) {
+        auto embedded =
+            loadEmbeddedJpegThumbnail(jpegHeader.value(), thumbnailSize);
+        if (embedded) {
+            decoded.width   = jpegHeader.value().width;
+            decoded.height  = jpegHeader.value().height;
+            decoded.surface = createThumbnailSurface(
+                embedded.value().get(), thumbnailSize, thumbnailSize);
+            return decoded.surface.has_value();
+        }
+    }
+    return false;
+}
+
+auto ImageLoaderPolicy::decodeThumbnail(std::size_t index,
+                                        const std::string& filename,
+                                        int thumbnailSize,
+                                        bool writeSharedThumbnail,
+                                        const std::atomic<bool>* cancelled)
+    -> DecodedThumbnail {
+    DecodedThumbnail decoded{index, thumbnailSize, std::nullopt, 0, 0, 0};
+    std::error_code error;
+    auto fileSize  = std::filesystem::file_size(filename, error);
+    decoded.memory = error ? 0 : (long)fileSize;
+
+    std::optional<JpegHeader> jpegHeader;
+    if (loadPreviewThumbnail(filename, decoded, jpegHeader)) {
+        return decoded;
+    }
+
+    // Everything below decodes the full image
+    if (cancelled != nullptr && cancelled->load()) {
+        return decoded;
+    }
+
+    std::optional<SdlSurface> image;
+#ifdef AIV_USE_LIBJPEG
+    if (jpegHeader) {
+        // Big enough for the shared thumbnail too, if it has to be saved
+        int minSize = writeSharedThumbnail ? sharedThumbnailSize(thumbnailSize)
+                                           : thumbnailSize;
+        image = loadScaledJpeg(filename, minSize, decoded.width, decoded.height,
+                               cancelled);
+    }
+#endif
+    if (!image) {
+        if (cancelled != nullptr && cancelled->load()) {
+            return decoded;
+        }
+        image = loadSurface(filename, cancelled);
+        if (!image) {
+            return decoded;
+        }
+        decoded.width  = image.value()->w;
+        decoded.height = image.value()->h;
+    }
+    decoded.surface = createThumbnailSurface(image.value().get(), thumbnailSize,
+                                             thumbnailSize);
+    if (writeSharedThumbnail) {
+        saveSharedThumbnail(filename, thumbnailSize, image.value().get(),
+                            decoded.width, decoded.height);
+    }
+    return decoded;
+}
+
+auto ImageLoaderPolicy::getThumbnailLevel(int thumbnailSize) -> int {
+    for (int level : kThumbnailLevels) {
+        if (level >= thumbnailSize) {
+            return level;
+        }
+    }
+    return kThumbnailLevels.back();
+}
+
+void ImageLoaderPolicy::updateThumbnailLevel(SdlContext& sdlContext) {
+    int level = getThumbnailLevel(sdlContext.style.thumbnailSize);
+    if (level == thumbnailLevel) {
+        return;
+    }
+    thumbnailLevel = level;
+    // The jobs of the old level are not needed anymore
+    cancelThumbnails(0, 0);
+
+    auto& gridImagesState = sdlContext.gridImagesState;
+    int firstVisible      = gridImagesState.rowsScroll * gridImagesState.numColumns;
+    int lastVisible =
+        firstVisible + gridImagesState.numRows * gridImagesState.numColumns;
 
-    const auto loadThumbnailLambda = [&](auto it) {
-        std::size_t index =
-            std::clamp((int)std::distance(v.begin(), it), 0, (int)v.size());
+    for (std::size_t index = 0; index < loadedThumbnails.size(); ++index) {
+        auto& imageHeader = sdlContext.imagesVector[index];
+        // The old levels stay on screen until the new ones are loaded. The
+        // ones out of view are released, they would only hold atlas space
+        // until they are scrolled into view and replaced.
+        bool visible = (int)index >= firstVisible && (int)index < lastVisible;
+        if (imageHeader.thumbnail && imageHeader.thumbnailLevel != level &&
+            !visible) {
+            releaseThumbnail(sdlContext, index);
+        }
+        loadedThumbnails[index] =
+            imageHeader.thumbnail && imageHeader.thumbnailLevel == level;
+    }
+}
+
+void ImageLoaderPolicy::setThumbnail(SdlContext& sdlContext, std::size_t index,
+                                     const AtlasRegion& region, int level) {
+    auto& imageHeader = sdlContext.imagesVector[index];
+    if (imageHeader.thumbnail) {
+        thumbnailAtlas.erase(sdlContext.renderer, imageHeader.thumbnail.value());
+    }
+    imageHeader.thumbnail      = region;
+    imageHeader.thumbnailLevel = level;
+    changed                    = true;
+    thumbnailIndices.insert(index);
+    updateThumbnailMemory();
+}
+
+void ImageLoaderPolicy::releaseThumbnail(SdlContext& sdlContext,
+                                         std::size_t index) {
+    auto& imageHeader = sdlContext.imagesVector[index];
+    if (!imageHeader.thumbnail) {
+        return;
+    }
+    thumbnailAtlas.erase(sdlContext.renderer, imageHeader.thumbnail.value());
+    imageHeader.thumbnail      = std::nullopt;
+    imageHeader.thumbnailLevel = 0;
+    loadedThumbnails[index]    = false;
+    thumbnailIndices.erase(index);
+}
+
+void ImageLoaderPolicy::updateThumbnailMemory() {
+    // The atlas is the only owner of the thumbnail memory
+    memoryAccounting.set(MemoryCategory::Thumbnails, 0,
+                         thumbnailAtlas.getMemory());
+}
+
+void ImageLoaderPolicy::readStoredDimensions(SdlContext& sdlContext) {
+    // One pass over the whole catalog, so the layout uses the real
+    // dimensions of every stored image before anything is decoded
+    auto thumbnailSize = thumbnailLevel;
+    for (auto& imageHeader : sdlContext.imagesVector) {
+        auto stored = thumbnailStore->find(imageHeader.fileAdress, thumbnailSize);
+        if (stored) {
+            imageHeader.width  = stored.value().originalWidth;
+            imageHeader.height = stored.value().originalHeight;
+        }
+    }
+}
+
+void ImageLoaderPolicy::uploadStoredThumbnails(SdlContext& sdlContext,
+                                               std::size_t first,
+                                               std::size_t last) {
+    auto thumbnailSize = thumbnailLevel;
+    for (std::size_t index = first; index < last; ++index) {
         if (loadedThumbnails[index]) {
-            return;
+            continue;
         }
-        int width, height;
-        long memory;
-		auto thumbnailSize = sdlContext.style.thumbnailSize;
-        auto thumbnail = createThumbnailWithSize(
-            sdlContext.renderer, sdlContext.imagesVector[index].fileAdress, thumbnailSize,
-            thumbnailSize, width, height, memory);
-        lastLoadedThumbnail += 1;
+        auto& imageHeader = sdlContext.imagesVector[index];
+        auto stored = thumbnailStore->find(imageHeader.fileAdress, thumbnailSize);
+        if (!stored) {
+            continue;
+        }
+        auto region = thumbnailAtlas.insert(sdlContext.renderer,
+                                            stored.value().surface.get());
+        if (!region) {
+            continue;
+        }
+        std::error_code error;
+        auto fileSize = std::filesystem::file_size(imageHeader.fileAdress, error);
+
         loadedThumbnails[index] = true;
-        if (!thumbnail) {
-            return;
+        setThumbnail(sdlContext, index, region.value(), thumbnailSize);
+        imageHeader.width  = stored.value().originalWidth;
+        imageHeader.height = stored.value().originalHeight;
+        imageHeader.memory = error ? 0 : (long)fileSize;
+    }
+}
+
+void ImageLoaderPolicy::uploadThumbnail(SdlContext& sdlContext,
+                                        DecodedThumbnail& decoded) {
+    if (!decoded.surface) {
+        return;
+    }
+    auto& imageHeader = sdlContext.imagesVector[decoded.index];
+    if (thumbnailStore) {
+        thumbnailStore->insert(imageHeader.fileAdress, decoded.thumbnailSize,
+                               decoded.surface.value().get(), decoded.width,
+                               decoded.height);
+    }
+    // Decoded before the zoom crossed a level. It is only shown when the
+    // image has nothing better, the right level is already requested.
+    if (decoded.thumbnailSize != thumbnailLevel && imageHeader.thumbnail) {
+        return;
+    }
+
+    auto region = thumbnailAtlas.insert(sdlContext.renderer,
+                                        decoded.surface.value().get());
+    if (!region) {
+        return;
+    }
+    setThumbnail(sdlContext, decoded.index, region.value(),
+                 decoded.thumbnailSize);
+    imageHeader.width  = decoded.width;
+    imageHeader.height = decoded.height;
+    imageHeader.memory = decoded.memory;
+}
+
+void ImageLoaderPolicy::uploadDecodedThumbnails(SdlContext& sdlContext) {
+    int loaded = 0;
+    for (auto& decoded : decodedThumbnails.drain()) {
+        if (!takeFromFlight(thumbnailsInFlight, decoded.index,
+                            decoded.cancelled) ||
+            !decoded.surface) {
+            continue;
+        }
+        // Cancelled too late to save any work, so it is used anyway
+        if (decoded.cancelled->load() &&
+            decoded.thumbnailSize == thumbnailLevel) {
+            loadedThumbnails[decoded.index] = true;
         }
+        uploadThumbnail(sdlContext, decoded);
+        loaded += 1;
+    }
+    updateThroughput(loaded);
+}
 
-        sdlContext.imagesVector[index].thumbnail = std::move(thumbnail);
-        sdlContext.imagesVector[index].width     = width;
-        sdlContext.imagesVector[index].height    = height;
-        sdlContext.imagesVector[index].memory    = memory;
-    };
+void ImageLoaderPolicy::updateThroughput(int loaded, bool endOfFrame) {
+    constexpr static Uint32 kWindowDuration = 1000;
 
-    const auto& [rFirstIt, lastIt] = getFrontierIterators();
-    auto it = findUnloadedImageIterator(rFirstIt, lastIt);
-    loadThumbnailLambda(it);
+    Uint32 now = SDL_GetTicks();
+    if (windowStartTime == 0) {
+        windowStartTime = now;
+    }
+    loadedInWindow += loaded;
+    if (endOfFrame) {
+        framesInWindow += 1;
+    }
+
+    Uint32 elapsed = now - windowStartTime;
+    if (elapsed >= kWindowDuration) {
+        throughput = (float)loadedInWindow * 1000.f / (float)elapsed;
+        throughputPerFrame =
+            (float)loadedInWindow / (float)std::max(framesInWindow, 1);
+        loadedInWindow  = 0;
+        framesInWindow  = 0;
+        windowStartTime = now;
+    }
+}
+
+auto ImageLoaderPolicy::thumbnailsPerSecond() const -> float {
+    return throughput;
+}
+
+auto ImageLoaderPolicy::thumbnailsPerFrame() const -> float {
+    return throughputPerFrame;
+}
+
+auto ImageLoaderPolicy::getThumbnailAtlas() -> ThumbnailAtlas& {
+    return thumbnailAtlas;
 }
 
 void ImageLoaderPolicy::loadInViewer(SdlContext& sdlContext) {
-    std::vector<std::size_t> elementsToErase;
+    const auto loadTiledImage = [&](const auto& index) {
+        auto& imageHeader  = sdlContext.imagesVector[index];
+        int maxTextureSize = getMaxTextureSize(sdlContext.renderer);
+        auto surface       = loadSurface(imageHeader.fileAdress);
+        if (!surface) {
+            return;
+        }
+        auto overview = createThumbnailSurface(surface.value().get(),
+                                               maxTextureSize, maxTextureSize);
+        if (!overview) {
+            return;
+        }
+        int width  = surface.value()->w;
+        int height = surface.value()->h;
+        imageHeader.tiledImage =
+            createTiledImage(sdlContext.renderer, std::move(surface.value()),
+                             overview.value().get());
+        if (imageHeader.tiledImage) {
+            std::error_code error;
+            auto fileSize =
+                std::filesystem::file_size(imageHeader.fileAdress, error);
+            imageHeader.memory = error ? 0 : (long)fileSize;
+            imageHeader.width  = width;
+            imageHeader.height = height;
+            changed            = true;
+            touchImage(sdlContext, index);
+        }
+    };
 
     const auto loadImage = [&](const auto& index) {
+        // The probed dimensions tell which images do not fit in a texture
+        const auto& imageHeader = sdlContext.imagesVector[index];
+        if (imageHeader.numFrames == 1 &&
+            needsTiling(imageHeader.width, imageHeader.height,
+                        getMaxTextureSize(sdlContext.renderer))) {
+            loadTiledImage(index);
+            return;
+        }
         if (!loadGifAnimation(sdlContext.renderer,
                               sdlContext.imagesVector[index])) {
             auto texture = createTexture(
@@ -118,43 +711,406 @@ void ImageLoaderPolicy::loadInViewer(SdlContext& sdlContext) {
                 sdlContext.imagesVector[index].memory = memory;
                 sdlContext.imagesVector[index].width  = size.x;
                 sdlContext.imagesVector[index].height = size.y;
-                loadedImages.insert(index);
+                changed                               = true;
+                touchImage(sdlContext, index);
             }
         } else {
-            loadedImages.insert(index);
+            changed = true;
+            touchImage(sdlContext, index);
         }
     };
 
-    const auto unloadImage = [&](const auto& index) {
-        sdlContext.imagesVector[index].image     = std::nullopt;
-        sdlContext.imagesVector[index].animation = std::nullopt;
-        auto it                                  = loadedImages.find(index);
-        if (it != loadedImages.end()) {
-            elementsToErase.push_back(*it);
+    auto wantedImages = getWantedImages(sdlContext);
+    const auto isWanted = [&](std::size_t index) {
+        return std::find(wantedImages.begin(), wantedImages.end(), index) !=
+               wantedImages.end();
+    };
+    // The pyramids keep no full resolution level, it is decoded again while
+    // the image is on screen and zoomed in
+    const auto needsFullResolution = [&](std::size_t index) {
+        const auto& pyramid = sdlContext.imagesVector[index].pyramid;
+        return pyramid && pyramid.value().needsFullResolution &&
+               sdlContext.imagesToLoad.count(index) != 0;
+    };
+
+    if (workerPool) {
+        uploadDecodedImages(sdlContext, isWanted);
+        uploadDecodedPyramids(sdlContext);
+    }
+    // Stored thumbnails of the images on screen are shown while they load,
+    // even if the grid was never opened
+    if (thumbnailStore) {
+        for (auto index : sdlContext.imagesToLoad) {
+            if (!sdlContext.imagesVector[index].thumbnail) {
+                uploadStoredThumbnails(sdlContext, index, index + 1);
+            }
+        }
+    }
+    for (auto it = imagesInFlight.begin(); it != imagesInFlight.end();) {
+        if (isWanted(it->first) && (!imageCache.contains(it->first) ||
+                                    needsFullResolution(it->first))) {
+            ++it;
+            continue;
+        }
+        it->second->store(true);
+        it = imagesInFlight.erase(it);
+    }
+
+    // Only images already probed as still ones are decoded by the workers,
+    // animations are loaded in the main thread when they are shown
+    const std::size_t maxInFlight = workerPool ? workerPool->numThreads() : 0;
+    for (auto index : wantedImages) {
+        bool isShown = sdlContext.imagesToLoad.count(index) != 0;
+        if (imageCache.contains(index)) {
+            // Keeps the images on screen and the prefetched ones as the most
+            // recently used
+            touchImage(sdlContext, index);
+            if (needsFullResolution(index) &&
+                imagesInFlight.count(index) == 0) {
+                submitImage(sdlContext, index);
+            }
+            continue;
+        }
+        if (imagesInFlight.count(index) != 0) {
+            continue;
+        }
+        bool isStill = sdlContext.imagesVector[index].numFrames == 1;
+        if (workerPool && isStill &&
+            (isShown || imagesInFlight.size() < maxInFlight)) {
+            submitImage(sdlContext, index);
+        } else if (isShown) {
+            // Decoded in the main thread. If there is a thumbnail, it is
+            // presented for a frame before blocking on the decode.
+            bool hasThumbnail = sdlContext.imagesVector[index].thumbnail.has_value();
+            if (hasThumbnail && deferredImages.insert(index).second) {
+                continue;
+            }
+            deferredImages.erase(index);
+            loadImage(index);
+        }
+    }
+    for (auto it = deferredImages.begin(); it != deferredImages.end();) {
+        it = isWanted(*it) ? std::next(it) : deferredImages.erase(it);
+    }
+
+    // The images that left the window stay loaded while they fit in the
+    // budget, so going back to them or toggling the grid is instant
+    for (auto index : imageCache.evict(isWanted)) {
+        unloadImage(sdlContext, index);
+    }
+
+    // Only the thumbnails drawn in place of the images are needed here
+    if (!sdlContext.imagesToLoad.empty()) {
+        auto [first, last] = std::minmax_element(
+            sdlContext.imagesToLoad.begin(), sdlContext.imagesToLoad.end());
+        thumbnailWindowFirst = *first;
+        thumbnailWindowLast  = *last + 1;
+    }
+}
+
+void ImageLoaderPolicy::updateNavigationDirection(int currentImage) {
+    if (currentImage > lastCurrentImage) {
+        navigationDirection = 1;
+    } else if (currentImage < lastCurrentImage) {
+        navigationDirection = -1;
+    }
+    lastCurrentImage = currentImage;
+}
+
+auto ImageLoaderPolicy::getWantedImages(SdlContext& sdlContext)
+    -> std::vector<std::size_t> {
+    int currentImage = sdlContext.currentImage;
+    int numImages    = (int)sdlContext.imagesVector.size();
+    updateNavigationDirection(currentImage);
+
+    // The images on screen, the current one first
+    std::vector<std::size_t> wantedImages(sdlContext.imagesToLoad.begin(),
+                                          sdlContext.imagesToLoad.end());
+    std::sort(wantedImages.begin(), wantedImages.end(),
+              [&](std::size_t a, std::size_t b) {
+                  return std::abs((int)a - currentImage) <
+                         std::abs((int)b - currentImage);
+              });
+    if (!workerPool) {
+        return wantedImages;
+    }
+
+    // Then the neighbours, alternating between the ones ahead in the
+    // direction of the navigation and the ones behind, which are half
+    int imagesBehind = (prefetchImages + 1) / 2;
+    const auto addImage = [&](int index) {
+        if (index >= 0 && index < numImages &&
+            std::find(wantedImages.begin(), wantedImages.end(), index) ==
+                wantedImages.end()) {
+            wantedImages.push_back(index);
         }
     };
+    for (int distance = 1; distance <= prefetchImages; ++distance) {
+        addImage(currentImage + navigationDirection * distance);
+        if (distance <= imagesBehind) {
+            addImage(currentImage - navigationDirection * distance);
+        }
+    }
+    return wantedImages;
+}
 
-    for (auto& toLoad : sdlContext.imagesToLoad) {
-        if (loadedImages.find(toLoad) == loadedImages.end()) {
-            loadImage(toLoad);
+void ImageLoaderPolicy::submitImage(SdlContext& sdlContext,
+                                    std::size_t index) {
+    auto cancelled        = std::make_shared<std::atomic<bool>>(false);
+    imagesInFlight[index] = cancelled;
+    workerPool->submit(
+        [this, index, filename = sdlContext.imagesVector[index].fileAdress,
+         maxTextureSize = getMaxTextureSize(sdlContext.renderer), cancelled]() {
+            DecodedImage decoded{index, std::nullopt, 0, cancelled};
+            if (!cancelled->load()) {
+                // Stops reading the file as soon as the cursor moves away,
+                // so the workers are free for the new images
+                decoded.surface = loadSurface(filename, cancelled.get());
+                if (decoded.surface &&
+                    needsTiling(decoded.surface.value()->w,
+                                decoded.surface.value()->h, maxTextureSize)) {
+                    decoded.overview = createThumbnailSurface(
+                        decoded.surface.value().get(), maxTextureSize,
+                        maxTextureSize);
+                }
+                std::error_code error;
+                auto fileSize  = std::filesystem::file_size(filename, error);
+                decoded.memory = error ? 0 : (long)fileSize;
+            }
+            decodedImages.push(std::move(decoded));
+            wakeUpMainLoop();
+        },
+        cancelled);
+}
+
+void ImageLoaderPolicy::uploadDecodedImages(
+    SdlContext& sdlContext, const std::function<bool(std::size_t)>& isWanted) {
+    for (auto& decoded : decodedImages.drain()) {
+        auto it = imagesInFlight.find(decoded.index);
+        if (it != imagesInFlight.end() && it->second == decoded.cancelled) {
+            imagesInFlight.erase(it);
+        }
+        // An image cancelled because it left the window would only be
+        // evicted again, after being uploaded and downscaled for nothing
+        if (decoded.cancelled->load() && !isWanted(decoded.index)) {
+            continue;
         }
+        auto& imageHeader = sdlContext.imagesVector[decoded.index];
+        if (decoded.surface && imageHeader.pyramid) {
+            uploadFullResolution(sdlContext, decoded);
+            continue;
+        }
+        // A cancelled image wanted again is used, its new decode is then
+        // ignored
+        if (!decoded.surface || imageCache.contains(decoded.index)) {
+            continue;
+        }
+        int width  = decoded.surface.value()->w;
+        int height = decoded.surface.value()->h;
+        if (decoded.overview) {
+            imageHeader.tiledImage = createTiledImage(
+                sdlContext.renderer, std::move(decoded.surface.value()),
+                decoded.overview.value().get());
+            if (!imageHeader.tiledImage) {
+                continue;
+            }
+        } else {
+            SDL_Texture* texture = SDL_CreateTextureFromSurface(
+                sdlContext.renderer.get(), decoded.surface.value().get());
+            if (texture == nullptr) {
+                continue;
+            }
+            imageHeader.image = createTexture(texture);
+            // The full resolution is shown right away, the levels replace it
+            // when they are ready
+            if (hasPyramidLevels(width, height)) {
+                submitPyramid(decoded.index, std::move(decoded.surface.value()));
+            }
+        }
+        imageHeader.width  = width;
+        imageHeader.height = height;
+        imageHeader.memory = decoded.memory;
+        changed            = true;
+        touchImage(sdlContext, decoded.index);
+    }
+}
+
+void ImageLoaderPolicy::uploadFullResolution(SdlContext& sdlContext,
+                                             DecodedImage& decoded) {
+    auto& imageHeader = sdlContext.imagesVector[decoded.index];
+    auto& pyramid     = imageHeader.pyramid.value();
+    // The zoom could have gone back down, or the image left the screen,
+    // while it was decoded
+    if (!pyramid.needsFullResolution || decoded.cancelled->load()) {
+        return;
     }
+    SDL_Texture* texture = SDL_CreateTextureFromSurface(
+        sdlContext.renderer.get(), decoded.surface.value().get());
+    if (texture == nullptr) {
+        return;
+    }
+    // Only the texture is kept, it is replaced by a smaller level as soon as
+    // the image is drawn smaller
+    imageHeader.image           = createTexture(texture);
+    pyramid.uploadedLevel       = 0;
+    pyramid.needsFullResolution = false;
+    changed                     = true;
+    touchImage(sdlContext, decoded.index);
+}
+
+void ImageLoaderPolicy::submitPyramid(std::size_t index, SdlSurface image) {
+    auto cancelled          = std::make_shared<std::atomic<bool>>(false);
+    pyramidsInFlight[index] = cancelled;
+    // The surface is moved into a shared_ptr because the jobs are copyable
+    auto shared = std::make_shared<SdlSurface>(std::move(image));
+    workerPool->submit([this, index, shared, cancelled]() {
+        DecodedPyramid decoded{index, {}, cancelled};
+        if (!cancelled->load()) {
+            decoded.levels =
+                buildPyramidLevels(std::move(*shared), cancelled.get());
+        }
+        // The full resolution is only kept as the texture uploaded, and it
+        // is decoded again if it is needed after that texture is replaced
+        if (!decoded.levels.empty()) {
+            decoded.levels.front().reset();
+        }
+        decodedPyramids.push(std::move(decoded));
+        wakeUpMainLoop();
+    });
+}
 
-    for (auto& toUnload : loadedImages) {
-        if (sdlContext.imagesToLoad.find(toUnload) == loadedImages.end()) {
-            unloadImage(toUnload);
+void ImageLoaderPolicy::uploadDecodedPyramids(SdlContext& sdlContext) {
+    for (auto& decoded : decodedPyramids.drain()) {
+        auto it = pyramidsInFlight.find(decoded.index);
+        if (it == pyramidsInFlight.end() || it->second != decoded.cancelled) {
+            // The image was unloaded while the levels were built
+            continue;
         }
+        pyramidsInFlight.erase(it);
+        auto& imageHeader = sdlContext.imagesVector[decoded.index];
+        if (decoded.levels.empty() || !imageHeader.image) {
+            continue;
+        }
+        // The texture uploaded is the full resolution level
+        imageHeader.pyramid = ImagePyramid{std::move(decoded.levels), 0, false};
+        changed             = true;
+        touchImage(sdlContext, decoded.index);
+    }
+}
+
+void ImageLoaderPolicy::touchImage(SdlContext& sdlContext, std::size_t index) {
+    const auto& imageHeader = sdlContext.imagesVector[index];
+    long bytes              = getDecodedSize(imageHeader);
+    imageCache.touch(index, bytes);
+    if (imageHeader.animation) {
+        memoryAccounting.set(MemoryCategory::Animations, index, bytes);
+    } else {
+        memoryAccounting.set(MemoryCategory::Images, index, bytes);
+    }
+}
+
+void ImageLoaderPolicy::unloadImage(SdlContext& sdlContext,
+                                    std::size_t index) {
+    auto& imageHeader      = sdlContext.imagesVector[index];
+    imageHeader.image      = std::nullopt;
+    imageHeader.pyramid    = std::nullopt;
+    imageHeader.animation  = std::nullopt;
+    imageHeader.tiledImage = std::nullopt;
+    imageCache.erase(index);
+    memoryAccounting.erase(MemoryCategory::Images, index);
+    memoryAccounting.erase(MemoryCategory::Animations, index);
+    auto pyramid = pyramidsInFlight.find(index);
+    if (pyramid != pyramidsInFlight.end()) {
+        pyramid->second->store(true);
+        pyramidsInFlight.erase(pyramid);
+    }
+}
+
+void ImageLoaderPolicy::enforceMemoryBudget(SdlContext& sdlContext) {
+    // The image cache gets what the thumbnails leave of the budget
+    long thumbnailBytes = memoryAccounting.getBytes(MemoryCategory::Thumbnails);
+    imageCache.setBudget(std::clamp(
+        memoryAccounting.getBudget() - thumbnailBytes, 0L, imageCacheSize));
+    const auto isShown = [&](std::size_t index) {
+        return sdlContext.imagesToLoad.count(index) != 0;
+    };
+    for (auto index : imageCache.evict(isShown)) {
+        unloadImage(sdlContext, index);
+    }
+
+    if (memoryAccounting.excessBytes() <= 0) {
+        return;
     }
+    thumbnailAtlas.releaseEmptyPages();
+    updateThumbnailMemory();
 
-    for (auto& element : elementsToErase) {
-        loadedImages.erase(element);
+    // The released thumbnails are loaded again, usually from the store, if
+    // the window reaches them. Their memory is only freed once their page
+    // is empty.
+    long current = sdlContext.currentImage;
+    while (memoryAccounting.excessBytes() > 0 && !thumbnailIndices.empty()) {
+        auto low  = *thumbnailIndices.begin();
+        auto high = *thumbnailIndices.rbegin();
+        bool canReleaseLow  = low < thumbnailWindowFirst;
+        bool canReleaseHigh = high >= thumbnailWindowLast;
+        if (!canReleaseLow && !canReleaseHigh) {
+            break;
+        }
+        bool releaseLow =
+            canReleaseLow &&
+            (!canReleaseHigh ||
+             std::abs(current - (long)low) >= std::abs((long)high - current));
+        releaseThumbnail(sdlContext, releaseLow ? low : high);
+        if (thumbnailAtlas.releaseEmptyPages() > 0) {
+            updateThumbnailMemory();
+        }
     }
 }
 
-void ImageLoaderPolicy::loadNext(SdlContext& sdlContext) {
+auto ImageLoaderPolicy::getMemoryAccounting() const
+    -> const MemoryAccounting& {
+    return memoryAccounting;
+}
+
+auto ImageLoaderPolicy::getDecodedSize(const ImageHeader& imageHeader)
+    -> long {
+    long size = 0;
+    if (imageHeader.image) {
+        size += getTextureMemory(imageHeader.image.value().get());
+    }
+    if (imageHeader.pyramid) {
+        size += getPyramidMemory(imageHeader.pyramid.value());
+    }
+    if (imageHeader.tiledImage) {
+        size += getTiledImageMemory(imageHeader.tiledImage.value());
+    }
+    if (imageHeader.animation) {
+        size += getAnimationMemory(imageHeader.animation.value());
+    }
+    return size;
+}
+
+auto ImageLoaderPolicy::loadNext(SdlContext& sdlContext) -> bool {
+    changed        = false;
+    hasPendingWork = false;
+    updateThumbnailLevel(sdlContext);
+    if (thumbnailStore && !storedDimensionsRead) {
+        readStoredDimensions(sdlContext);
+        storedDimensionsRead = true;
+    }
+    if (workerPool) {
+        uploadDecodedThumbnails(sdlContext);
+    }
     if (sdlContext.isGridImages) {
         loadInGrid(sdlContext);
     } else {
         loadInViewer(sdlContext);
     }
+    enforceMemoryBudget(sdlContext);
+    // Lets the throughput drop to 0 once nothing else is loaded
+    updateThroughput(0, true);
+    // The deferred images are loaded after their thumbnail is presented,
+    // and the throughput in the bar has to reach 0
+    return changed || hasPendingWork || !deferredImages.empty() ||
+           throughput > 0;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ImageLoaderPolicy.hpp"
+#include "GlyphAtlas.hpp"
 #include "cacheFilenames.hpp"
 #include "command.hpp"
 #include "typesDefinition.hpp"
@@ -9,13 +10,15 @@ class ImageViewerApp {
   public:
     ImageViewerApp(SdlContext&& sdlContextArg)
         : sdlContext(std::move(sdlContextArg)),
-          imageLoaderPolicy((int)sdlContext.imagesVector.size()),
+          imageLoaderPolicy((int)sdlContext.imagesVector.size(),
+                            sdlContext.loaderSettings),
           commandExecuter(sdlContext.configStruct) {
     }
 
     void drawBottomBarBackground();
-    void drawBottomLeftText(const std::string& text);
-    void drawBottomRightText(const std::string& text);
+    // Queues the segments one after the other in the glyph atlas
+    void drawBottomLeftText(const std::vector<std::string>& segments);
+    void drawBottomRightText(const std::vector<std::string>& segments);
     void drawBottomBar();
 
     void maybeToggleFullscreen();
@@ -25,18 +28,39 @@ class ImageViewerApp {
     void setImagesToLoad();
 
     void drawGrid();
+    // Under each thumbnail of the grid, if the font fits in the padding
+    void drawFilenames();
     void drawImageViewer();
     void drawImageViewerContiguous();
+    // Moves the animation to its frame due now, before it is drawn
+    void advanceAnimation(SdlAnimation& animation);
+    // Seeks the animation of the current image to the frame asked by the
+    // commands
+    void applyAnimationCommands();
 
     void mainLoop();
 
   private:
+    auto isWindowVisible() -> bool;
+    // Milliseconds to wait for events before the next frame is due, -1 to
+    // wait until one arrives
+    auto getWaitTimeout(bool dirty, bool visible, Uint64 lastFrameTime)
+        -> int;
+
     std::string inputCommand;
     SdlContext sdlContext;
     SDL_Event event;
     CommandExecuter commandExecuter;
     ImageLoaderPolicy imageLoaderPolicy;
     bool wasFullscreen{false};
+    // Used by the bar and the filenames of the grid
+    GlyphAtlas glyphAtlas;
+    // Time spent drawing the bottom bar, shown with --stats
+    float barMilliseconds{0.};
+    // Summed up on exit with --stats, to compare runs
+    int numBarDraws{0};
+    float totalBarMilliseconds{0.};
+    float maxBarMilliseconds{0.};
 };
 
 //**************************************************************
@@ -60,88 +84,103 @@ void ImageViewerApp::drawBottomBarBackground() {
     SDL_RenderFillRect(sdlContext.renderer.get(), &barRect);
 }
 
-void ImageViewerApp::drawBottomLeftText(const std::string& text) {
+void ImageViewerApp::drawBottomLeftText(
+    const std::vector<std::string>& segments) {
     // Get the window dimensions
     int windowWidth, windowHeight;
     SDL_GetWindowSize(sdlContext.window.get(), &windowWidth, &windowHeight);
 
-    // Set the color for drawing the text
-    SDL_SetRenderDrawColor(sdlContext.renderer.get(), 255, 255, 255, 255);
-
-    // Render the text
-    SDL_Surface* textSurface = TTF_RenderText_Blended(
-        sdlContext.font.value().get(), text.c_str(), {255, 255, 255});
-    SDL_Texture* textTexture =
-        SDL_CreateTextureFromSurface(sdlContext.renderer.get(), textSurface);
-    int barHeight     = 50;
-    int barY          = windowHeight - barHeight;
-    SDL_Rect textRect = {10, barY + 10, textSurface->w, textSurface->h};
-    SDL_RenderCopy(sdlContext.renderer.get(), textTexture, nullptr, &textRect);
-    SDL_DestroyTexture(textTexture);
-    SDL_FreeSurface(textSurface);
+    int barHeight = 50;
+    int barY      = windowHeight - barHeight;
+    int x         = 10;
+    for (const auto& segment : segments) {
+        x += glyphAtlas.addText(sdlContext.renderer,
+                                sdlContext.font.value().get(), segment, x,
+                                barY + 10, {255, 255, 255, 255});
+    }
 }
 
-void ImageViewerApp::drawBottomRightText(const std::string& text) {
+void ImageViewerApp::drawBottomRightText(
+    const std::vector<std::string>& segments) {
     // Get the window dimensions
     int windowWidth, windowHeight;
     SDL_GetWindowSize(sdlContext.window.get(), &windowWidth, &windowHeight);
 
-    // Set the color for drawing the text
-    SDL_SetRenderDrawColor(sdlContext.renderer.get(), 255, 255, 255, 255);
-
-    // Render the text
-    SDL_Surface* textSurface = TTF_RenderText_Blended(
-        sdlContext.font.value().get(), text.c_str(), {255, 255, 255});
-    SDL_Texture* textTexture =
-        SDL_CreateTextureFromSurface(sdlContext.renderer.get(), textSurface);
-    int barHeight     = 50;
-    int barY          = windowHeight - barHeight;
-    SDL_Rect textRect = {windowWidth - 10 - textSurface->w, barY + 10,
-                         textSurface->w, textSurface->h};
-    SDL_RenderCopy(sdlContext.renderer.get(), textTexture, nullptr, &textRect);
-    SDL_DestroyTexture(textTexture);
-    SDL_FreeSurface(textSurface);
+    int barHeight = 50;
+    int barY      = windowHeight - barHeight;
+    int width     = 0;
+    for (const auto& segment : segments) {
+        width += glyphAtlas.measure(sdlContext.renderer,
+                                    sdlContext.font.value().get(), segment);
+    }
+    // Ends at the right margin
+    int x = windowWidth - 10 - width;
+    for (const auto& segment : segments) {
+        x += glyphAtlas.addText(sdlContext.renderer,
+                                sdlContext.font.value().get(), segment, x,
+                                barY + 10, {255, 255, 255, 255});
+    }
 }
 
 void ImageViewerApp::drawBottomBar() {
     if (sdlContext.showBar && sdlContext.font) {
+        Uint64 startTime = SDL_GetPerformanceCounter();
         drawBottomBarBackground();
         const auto& imageHeader =
             sdlContext.imagesVector[sdlContext.currentImage];
-        std::string leftInfo =
-            "size : " + memoryToHumanReadable(imageHeader.memory);
-        leftInfo += ", " + std::to_string(imageHeader.width) + "x" +
-                    std::to_string(imageHeader.height);
-        leftInfo += ", address: " + imageHeader.fileAdress;
-        std::string rightInfo;
-
+        const auto& memoryAccounting = imageLoaderPolicy.getMemoryAccounting();
+        std::vector<std::string> leftInfo;
+        leftInfo.push_back("size : " +
+                           memoryToHumanReadable(imageHeader.memory));
+        leftInfo.push_back(
+            ", resident: " +
+            memoryToHumanReadable(memoryAccounting.totalBytes(), 0) + "/" +
+            memoryToHumanReadable(memoryAccounting.getBudget(), 0));
+        leftInfo.push_back(", " + std::to_string(imageHeader.width) + "x" +
+                           std::to_string(imageHeader.height));
+        leftInfo.push_back(", address: " + imageHeader.fileAdress);
+        std::vector<std::string> rightInfo;
+
+        if (sdlContext.showStats) {
+            std::stringstream ss;
+            ss << std::fixed << std::setprecision(3) << barMilliseconds
+               << " ms bar, ";
+            rightInfo.push_back(ss.str());
+        }
+        float thumbnailsPerSecond = imageLoaderPolicy.thumbnailsPerSecond();
+        if (sdlContext.isGridImages && thumbnailsPerSecond > 0) {
+            std::stringstream ss;
+            ss << std::fixed << std::setprecision(1) << thumbnailsPerSecond
+               << " img/s (" << imageLoaderPolicy.thumbnailsPerFrame()
+               << "/frame), ";
+            rightInfo.push_back(ss.str());
+        }
         if (imageHeader.animation) {
-            rightInfo +=
+            rightInfo.push_back(
                 std::to_string(imageHeader.animation.value().actualFrame) +
-                "/" +
-                std::to_string(imageHeader.animation.value().frames.size() -
-                               1) +
-                ", ";
+                "/" + std::to_string(std::max(imageHeader.numFrames, 1) - 1) +
+                (sdlContext.imageViewerState.animationPaused ? " paused, "
+                                                             : ", "));
         }
-        rightInfo += std::to_string(sdlContext.currentImage) + "/" +
-                     std::to_string(sdlContext.imagesVector.size() - 1);
+        rightInfo.push_back(std::to_string(sdlContext.currentImage) + "/" +
+                            std::to_string(sdlContext.imagesVector.size() - 1));
         drawBottomLeftText(leftInfo);
         drawBottomRightText(rightInfo);
+        glyphAtlas.drawBatch(sdlContext.renderer);
+
+        // Smoothed, so the number can be read while it changes every frame
+        float elapsed = (float)(SDL_GetPerformanceCounter() - startTime) *
+                        1000.f / (float)SDL_GetPerformanceFrequency();
+        barMilliseconds = barMilliseconds * 0.9f + elapsed * 0.1f;
+        numBarDraws += 1;
+        totalBarMilliseconds += elapsed;
+        maxBarMilliseconds = std::max(maxBarMilliseconds, elapsed);
     }
 }
 
 void ImageViewerApp::drawGrid() {
-    int numColumns                   = sdlContext.gridImagesState.numColumns;
-    int numRows                      = sdlContext.gridImagesState.numRows;
-    int imageRow                     = sdlContext.currentImage / numColumns;
-    int imageColumn                  = sdlContext.currentImage % numColumns;
-    const auto computeVerticalScroll = [&]() {
-        if (imageRow > sdlContext.gridImagesState.rowsScroll + numRows - 1) {
-            sdlContext.gridImagesState.rowsScroll = imageRow - numRows + 1;
-        } else if (imageRow < sdlContext.gridImagesState.rowsScroll) {
-            sdlContext.gridImagesState.rowsScroll = imageRow;
-        }
-    };
+    int numColumns = sdlContext.gridImagesState.numColumns;
+    int numRows    = sdlContext.gridImagesState.numRows;
 
     const auto drawImageBorder = [&](auto imageId, auto borderWidth,
                                      auto borderColor) {
@@ -168,6 +207,7 @@ void ImageViewerApp::drawGrid() {
         }
     };
 
+    auto& thumbnailAtlas = imageLoaderPolicy.getThumbnailAtlas();
     const auto drawImagesGrid = [&]() {
         auto rowsScroll = sdlContext.gridImagesState.rowsScroll;
         for (int i = rowsScroll; i < numRows + rowsScroll; ++i) {
@@ -216,18 +256,52 @@ void ImageViewerApp::drawGrid() {
                                           (sdlContext.style.thumbnailSize +
                                            sdlContext.style.padding),
                                   newWidth, newHeight};
-                SDL_RenderCopy(sdlContext.renderer.get(),
-                               image.thumbnail.value().get(), nullptr,
-                               &destRect);
+                thumbnailAtlas.addToBatch(image.thumbnail.value(), destRect);
             }
         }
     };
 
-    computeVerticalScroll();
     drawImageBorder(sdlContext.currentImage,
                     sdlContext.style.currentImageWidthBorder,
                     sdlContext.style.currentImageColorBorder);
     drawImagesGrid();
+    thumbnailAtlas.drawBatch(sdlContext.renderer);
+    drawFilenames();
+}
+
+void ImageViewerApp::drawFilenames() {
+    if (!sdlContext.font) {
+        return;
+    }
+    TTF_Font* font    = sdlContext.font.value().get();
+    int thumbnailSize = sdlContext.style.thumbnailSize;
+    int padding       = sdlContext.style.padding;
+    int lineHeight    = glyphAtlas.getLineHeight(font);
+    // Otherwise they would cover the thumbnails of the next row
+    if (lineHeight > padding) {
+        return;
+    }
+
+    int numColumns  = sdlContext.gridImagesState.numColumns;
+    int numRows     = sdlContext.gridImagesState.numRows;
+    auto rowsScroll = sdlContext.gridImagesState.rowsScroll;
+    for (int i = rowsScroll; i < numRows + rowsScroll; ++i) {
+        for (int j = 0; j < numColumns; ++j) {
+            std::size_t index = i * numColumns + j;
+            if (index >= sdlContext.imagesVector.size()) {
+                break;
+            }
+            const auto& fileAdress = sdlContext.imagesVector[index].fileAdress;
+            auto filename    = fileAdress.substr(fileAdress.rfind('/') + 1);
+            // Centered in the padding below the thumbnail
+            int x = padding + j * (thumbnailSize + padding);
+            int y = padding + (i - rowsScroll) * (thumbnailSize + padding) +
+                    thumbnailSize + (padding - lineHeight) / 2;
+            glyphAtlas.addText(sdlContext.renderer, font, filename, x, y,
+                               {255, 255, 255, 255}, thumbnailSize);
+        }
+    }
+    glyphAtlas.drawBatch(sdlContext.renderer);
 }
 
 void ImageViewerApp::maybeToggleFullscreen() {
@@ -252,6 +326,18 @@ void ImageViewerApp::preInputProcessing() {
     sdlContext.gridImagesState.numRows =
         (windowHeight - 2 * sdlContext.style.padding) /
         (sdlContext.style.thumbnailSize + sdlContext.style.padding);
+
+    // Computed before loading, so the loader sees the rows of a jump in the
+    // same frame
+    if (sdlContext.isGridImages && sdlContext.gridImagesState.numColumns > 0) {
+        auto& gridImagesState = sdlContext.gridImagesState;
+        int imageRow = sdlContext.currentImage / gridImagesState.numColumns;
+        if (imageRow > gridImagesState.rowsScroll + gridImagesState.numRows - 1) {
+            gridImagesState.rowsScroll = imageRow - gridImagesState.numRows + 1;
+        } else if (imageRow < gridImagesState.rowsScroll) {
+            gridImagesState.rowsScroll = imageRow;
+        }
+    }
 }
 
 void ImageViewerApp::getInputCommand() {
@@ -384,20 +470,28 @@ void ImageViewerApp::drawImageViewer() {
     int angle = imageViewerState.rotation * 90;
 
     // Draw the image to the renderer
+    if (image.pyramid) {
+        selectPyramidLevel(renderer, image, imageRect.w);
+    }
     if (image.image) {
         SDL_RenderCopyEx(renderer.get(), image.image.value().get(), nullptr,
                          &imageRect, angle, nullptr, flip);
     }
+    if (image.tiledImage) {
+        drawTiledImage(renderer, image.tiledImage.value(), imageRect,
+                       {0, 0, windowWidth, windowHeight}, angle, flip);
+    }
     if (image.animation) {
-        SDL_RenderCopyEx(renderer.get(),
-                         image.animation.value()
-                             .frames[image.animation.value().actualFrame]
-                             .get(),
+        advanceAnimation(image.animation.value());
+        SDL_RenderCopyEx(renderer.get(), image.animation.value().texture.get(),
                          nullptr, &imageRect, angle, nullptr, flip);
-        image.animation.value().actualFrame =
-            (int)(image.animation.value().actualFrame + 1) %
-            image.animation.value().frames.size();
-        sdlContext.fps = image.animation.value().fps;
+    }
+    // Until the full image is decoded, its thumbnail is scaled to the same
+    // rect, so there is no jump when it is replaced
+    if (!image.image && !image.tiledImage && !image.animation &&
+        image.thumbnail) {
+        imageLoaderPolicy.getThumbnailAtlas().drawRegion(
+            renderer, image.thumbnail.value(), imageRect, angle, flip);
     }
 }
 
@@ -450,18 +544,23 @@ void ImageViewerApp::drawImageViewerContiguous() {
         if (!center) {
             maybeChangeCurrentImage(index, yPos, drawHeight);
         }
+        if (image.pyramid) {
+            selectPyramidLevel(renderer, image, imageRect.w);
+        }
         if (image.image) {
             SDL_RenderCopy(renderer.get(), image.image.value().get(), nullptr,
                            &imageRect);
+        } else if (image.tiledImage) {
+            drawTiledImage(renderer, image.tiledImage.value(), imageRect,
+                           windowRect);
         } else if (image.animation) {
+            advanceAnimation(image.animation.value());
             SDL_RenderCopy(renderer.get(),
-                           image.animation.value()
-                               .frames[image.animation.value().actualFrame]
-                               .get(),
-                           nullptr, &imageRect);
-            image.animation.value().actualFrame =
-                (image.animation.value().actualFrame + 1) %
-                image.animation.value().frames.size();
+                           image.animation.value().texture.get(), nullptr,
+                           &imageRect);
+        } else if (image.thumbnail) {
+            imageLoaderPolicy.getThumbnailAtlas().drawRegion(
+                renderer, image.thumbnail.value(), imageRect);
         } else {
             return false;
         }
@@ -517,6 +616,50 @@ void ImageViewerApp::drawImageViewerContiguous() {
     sdlContext.currentImage = newCurrentImage;
 }
 
+void ImageViewerApp::advanceAnimation(SdlAnimation& animation) {
+    if (sdlContext.imageViewerState.animationPaused) {
+        // Restarts the timing of the frame on screen when it is resumed
+        animation.nextFrameTime = 0;
+        return;
+    }
+    ::advanceAnimation(animation, SDL_GetPerformanceCounter());
+    Uint64 deadline = getAnimationDeadline(animation);
+    if (deadline != 0 && (sdlContext.animationDeadline == 0 ||
+                          deadline < sdlContext.animationDeadline)) {
+        sdlContext.animationDeadline = deadline;
+    }
+}
+
+void ImageViewerApp::applyAnimationCommands() {
+    auto& imageViewerState = sdlContext.imageViewerState;
+    auto& image            = sdlContext.imagesVector[sdlContext.currentImage];
+    if (!sdlContext.isGridImages && image.animation) {
+        auto& animation = image.animation.value();
+        // The probed count is known before the decoder reaches the end
+        int numFrames = animation.decoder->getNumFrames();
+        if (numFrames == 0) {
+            numFrames = image.numFrames;
+        }
+        std::optional<int> index;
+        if (imageViewerState.animationSeek) {
+            index = imageViewerState.animationSeek.value();
+            if (numFrames > 0) {
+                index = std::min(index.value(), numFrames - 1);
+            }
+        } else if (imageViewerState.animationStep != 0) {
+            index = animation.actualFrame + imageViewerState.animationStep;
+            if (numFrames > 0) {
+                index = (index.value() % numFrames + numFrames) % numFrames;
+            }
+        }
+        if (index) {
+            seekAnimation(animation, std::max(index.value(), 0));
+        }
+    }
+    imageViewerState.animationStep = 0;
+    imageViewerState.animationSeek = std::nullopt;
+}
+
 void ImageViewerApp::setImagesToLoad() {
     if (sdlContext.isGridImages) {
         sdlContext.imagesToLoad.clear();
@@ -530,17 +673,83 @@ void ImageViewerApp::setImagesToLoad() {
     }
 }
 
+auto ImageViewerApp::isWindowVisible() -> bool {
+    Uint32 flags = SDL_GetWindowFlags(sdlContext.window.get());
+    return (flags & (SDL_WINDOW_HIDDEN | SDL_WINDOW_MINIMIZED)) == 0;
+}
+
+auto ImageViewerApp::getWaitTimeout(bool dirty, bool visible,
+                                    Uint64 lastFrameTime) -> int {
+    if (!visible) {
+        return -1;
+    }
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    // A changed frame is drawn at most fps times per second, so loading
+    // does not redraw after every thumbnail
+    Uint64 deadline = dirty ? lastFrameTime + frequency / sdlContext.fps : 0;
+    if (sdlContext.animationDeadline != 0 &&
+        (deadline == 0 || sdlContext.animationDeadline < deadline)) {
+        deadline = sdlContext.animationDeadline;
+    }
+    if (deadline == 0) {
+        return -1;
+    }
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now >= deadline) {
+        return 0;
+    }
+    // Rounded up, so the frame is due when the loop wakes up
+    return (int)(((deadline - now) * 1000 + frequency - 1) / frequency);
+}
+
 void ImageViewerApp::mainLoop() {
+    // Nothing is drawn until something changes: the input, the loaded
+    // images, the window or the frame of an animation
+    bool dirty           = true;
+    Uint64 lastFrameTime = 0;
     while (!sdlContext.exit) {
-        Uint32 frameStartTime = SDL_GetTicks();
-
-        while (SDL_PollEvent(&event)) {
+        bool visible = isWindowVisible();
+        int timeout  = getWaitTimeout(dirty, visible, lastFrameTime);
+        bool hasEvent;
+        if (timeout < 0) {
+            hasEvent = SDL_WaitEvent(&event) != 0;
+        } else if (timeout > 0) {
+            hasEvent = SDL_WaitEventTimeout(&event, timeout) != 0;
+        } else {
+            hasEvent = SDL_PollEvent(&event) != 0;
+        }
+        while (hasEvent) {
+            // The mouse is not used, and the wake up event only means that
+            // the loader has results
+            if (event.type != SDL_MOUSEMOTION &&
+                event.type != getWakeUpEventType()) {
+                dirty = true;
+            }
             getInputCommand();
+            hasEvent = SDL_PollEvent(&event) != 0;
         }
         preInputProcessing();
         maybeToggleFullscreen();
         setImagesToLoad();
-        imageLoaderPolicy.loadNext(sdlContext);
+        if (imageLoaderPolicy.loadNext(sdlContext)) {
+            dirty = true;
+        }
+        applyAnimationCommands();
+
+        visible           = isWindowVisible();
+        Uint64 frequency  = SDL_GetPerformanceFrequency();
+        Uint64 now        = SDL_GetPerformanceCounter();
+        bool animationDue = sdlContext.animationDeadline != 0 &&
+                            now >= sdlContext.animationDeadline;
+        bool frameDue =
+            dirty && now >= lastFrameTime + frequency / sdlContext.fps;
+        if (!visible || (!frameDue && !animationDue)) {
+            continue;
+        }
+        dirty                        = false;
+        lastFrameTime                = now;
+        sdlContext.animationDeadline = 0;
+
         SDL_RenderClear(sdlContext.renderer.get());
         if (sdlContext.isGridImages) {
             drawGrid();
@@ -552,16 +761,6 @@ void ImageViewerApp::mainLoop() {
         drawBottomBar();
         SDL_SetRenderDrawColor(sdlContext.renderer.get(), 30, 30, 30, 0x00);
         SDL_RenderPresent(sdlContext.renderer.get());
-
-        // Calculate the elapsed time for the frame
-        int elapsedTime = SDL_GetTicks() - frameStartTime;
-
-        int frameDelay = 1000 / sdlContext.fps;
-        // Delay the program to maintain the target frame rate
-        if (elapsedTime < frameDelay) {
-            SDL_Delay(frameDelay - elapsedTime);
-        }
-        sdlContext.fps = 24;
     }
     if (sdlContext.windowSettings.useCacheFile) {
         CacheFilenames cacheFilenames;
@@ -571,4 +770,11 @@ void ImageViewerApp::mainLoop() {
         std::cout << sdlContext.imagesVector[sdlContext.currentImage].fileAdress
                   << "\n";
     }
+    // On stderr, stdout can hold the output filename
+    if (sdlContext.showStats && numBarDraws > 0) {
+        std::cerr << std::fixed << std::setprecision(3) << "bar: "
+                  << numBarDraws << " draws, "
+                  << totalBarMilliseconds / (float)numBarDraws << " ms mean, "
+                  << maxBarMilliseconds << " ms max\n";
+    }
 }
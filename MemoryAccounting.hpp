@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+
+enum class MemoryCategory { Thumbnails, Images, Animations };
+
+// Bytes of decoded pixels held by aiv, in textures or surfaces, by category
+// and by owner, which is the index of the image they belong to. Setting the
+// bytes of an owner again replaces the previous value, so the callers only
+// report the current size of what they hold.
+class MemoryAccounting {
+  public:
+    MemoryAccounting(long budget) : budget(budget) {
+    }
+
+    void set(MemoryCategory category, std::size_t owner, long bytes);
+    void erase(MemoryCategory category, std::size_t owner);
+
+    auto getBytes(MemoryCategory category) const -> long;
+    auto totalBytes() const -> long;
+    auto getBudget() const -> long;
+    // Bytes that have to be released to fit in the budget, 0 if they fit
+    auto excessBytes() const -> long;
+
+  private:
+    constexpr static std::size_t kNumCategories = 3;
+
+    std::array<std::unordered_map<std::size_t, long>, kNumCategories> owners;
+    std::array<long, kNumCategories> totals{};
+    long budget;
+};
+
+//**************************************************************
+//********************* Implementation *************************
+//**************************************************************
+
+void MemoryAccounting::set(MemoryCategory category, std::size_t owner,
+                           long bytes) {
+    auto& ownerBytes = owners[(std::size_t)category][owner];
+    totals[(std::size_t)category] += bytes - ownerBytes;
+    ownerBytes = bytes;
+}
+
+void MemoryAccounting::erase(MemoryCategory category, std::size_t owner) {
+    auto& categoryOwners = owners[(std::size_t)category];
+    auto it              = categoryOwners.find(owner);
+    if (it == categoryOwners.end()) {
+        return;
+    }
+    totals[(std::size_t)category] -= it->second;
+    categoryOwners.erase(it);
+}
+
+auto MemoryAccounting::getBytes(MemoryCategory category) const -> long {
+    return totals[(std::size_t)category];
+}
+
+auto MemoryAccounting::totalBytes() const -> long {
+    long total = 0;
+    for (long bytes : totals) {
+        total += bytes;
+    }
+    return total;
+}
+
+auto MemoryAccounting::getBudget() const -> long {
+    return budget;
+}
+
+auto MemoryAccounting::excessBytes() const -> long {
+    return std::max(totalBytes() - budget, 0L);
+}
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "AtlasLayout.hpp"
+#include "sdlUtils.hpp"
+#include "typesDefinition.hpp"
+
+// Packs the thumbnails into a few big textures, the pages, so the grid is
+// drawn with one SDL_RenderGeometry call per page instead of one
+// SDL_RenderCopy per thumbnail.
+//
+// The regions are placed by an AtlasLayout. The textures of the empty pages
+// are kept for the next thumbnails until releaseEmptyPages destroys them.
+//
+// It must only be used from the main thread.
+class ThumbnailAtlas {
+  public:
+    // Copies a surface of any format into a free region
+    auto insert(const SdlRenderer& renderer, SDL_Surface* surface)
+        -> std::optional<AtlasRegion>;
+
+    // Copies a texture into a free region by rendering it into the page
+    auto insert(const SdlRenderer& renderer, SDL_Texture* texture)
+        -> std::optional<AtlasRegion>;
+
+    void erase(const SdlRenderer& renderer, const AtlasRegion& region);
+
+    // Copies the pixels of a region back to a RGBA32 surface. It stalls the
+    // renderer, so it is only for the thumbnails scaled in the GPU.
+    auto readRegion(const SdlRenderer& renderer, const AtlasRegion& region)
+        -> std::optional<SdlSurface>;
+
+    // Draws a single region at once, like SDL_RenderCopyEx
+    void drawRegion(const SdlRenderer& renderer, const AtlasRegion& region,
+                    const SDL_Rect& destRect, double angle = 0.,
+                    SDL_RendererFlip flip = SDL_FLIP_NONE);
+
+    // Queues a region to be drawn in destRect by the next drawBatch
+    void addToBatch(const AtlasRegion& region, const SDL_Rect& destRect);
+    void drawBatch(const SdlRenderer& renderer);
+
+    // Pages with a texture, empty or not
+    auto numPages() const -> int;
+    // Bytes of the textures of the pages, which is the memory the
+    // thumbnails take no matter how many regions are in use
+    auto getMemory() const -> long;
+    // Destroys the textures of the empty pages except one, so inserting a
+    // few thumbnails does not create a page again. Returns the bytes freed.
+    auto releaseEmptyPages() -> long;
+
+  private:
+    struct Page {
+        // Null once released
+        SdlTexture texture;
+        std::vector<SDL_Vertex> vertices;
+        std::vector<int> indices;
+    };
+
+    auto allocate(const SdlRenderer& renderer, int width, int height)
+        -> std::optional<AtlasRegion>;
+    // Returns false if the texture could not be created
+    auto createPage(const SdlRenderer& renderer) -> bool;
+    void clearRect(const SdlRenderer& renderer, Page& page,
+                   const SDL_Rect& rect);
+
+    constexpr static int kMaxPageSize = 2048;
+
+    // Same indices as the pages of the layout
+    std::vector<Page> pages;
+    AtlasLayout layout;
+    int pageSize{0};
+};
+
+//**************************************************************
+//********************* Implementation *************************
+//**************************************************************
+
+auto ThumbnailAtlas::insert(const SdlRenderer& renderer, SDL_Surface* surface)
+    -> std::optional<AtlasRegion> {
+    auto region = allocate(renderer, surface->w, surface->h);
+    if (!region) {
+        return std::nullopt;
+    }
+    SdlSurface converted(nullptr, &SDL_FreeSurface);
+    if (surface->format->format != SDL_PIXELFORMAT_RGBA32) {
+        converted = createSurface(
+            SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0));
+        if (!converted) {
+            erase(renderer, region.value());
+            return std::nullopt;
+        }
+        surface = converted.get();
+    }
+    auto& page = pages[region.value().page];
+    if (SDL_UpdateTexture(page.texture.get(), &region.value().rect,
+                          surface->pixels, surface->pitch) != 0) {
+        erase(renderer, region.value());
+        return std::nullopt;
+    }
+    return region;
+}
+
+auto ThumbnailAtlas::insert(const SdlRenderer& renderer, SDL_Texture* texture)
+    -> std::optional<AtlasRegion> {
+    int width, height;
+    SDL_QueryTexture(texture, nullptr, nullptr, &width, &height);
+    auto region = allocate(renderer, width, height);
+    if (!region) {
+        return std::nullopt;
+    }
+    // Replace the pixels of the region instead of blending over them
+    SDL_BlendMode blendMode;
+    SDL_GetTextureBlendMode(texture, &blendMode);
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE);
+
+    auto& page = pages[region.value().page];
+    SDL_SetRenderTarget(renderer.get(), page.texture.get());
+    SDL_RenderCopy(renderer.get(), texture, nullptr, &region.value().rect);
+    SDL_SetRenderTarget(renderer.get(), nullptr);
+    SDL_SetTextureBlendMode(texture, blendMode);
+    return region;
+}
+
+void ThumbnailAtlas::erase(const SdlRenderer& renderer,
+                           const AtlasRegion& region) {
+    // Smaller thumbnails may reuse it, so the old pixels must not be left
+    // around them
+    clearRect(renderer, pages[region.page], layout.erase(region));
+}
+
+auto ThumbnailAtlas::readRegion(const SdlRenderer& renderer,
+                                const AtlasRegion& region)
+    -> std::optional<SdlSurface> {
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(
+        0, region.rect.w, region.rect.h, 32, SDL_PIXELFORMAT_RGBA32);
+    if (surface == nullptr) {
+        return std::nullopt;
+    }
+    auto pixels = createSurface(surface);
+    SDL_SetRenderTarget(renderer.get(), pages[region.page].texture.get());
+    int result = SDL_RenderReadPixels(renderer.get(), &region.rect,
+                                      SDL_PIXELFORMAT_RGBA32, surface->pixels,
+                                      surface->pitch);
+    SDL_SetRenderTarget(renderer.get(), nullptr);
+    if (result != 0) {
+        return std::nullopt;
+    }
+    return pixels;
+}
+
+void ThumbnailAtlas::drawRegion(const SdlRenderer& renderer,
+                                const AtlasRegion& region,
+                                const SDL_Rect& destRect, double angle,
+                                SDL_RendererFlip flip) {
+    SDL_RenderCopyEx(renderer.get(), pages[region.page].texture.get(),
+                     &region.rect, &destRect, angle, nullptr, flip);
+}
+
+void ThumbnailAtlas::addToBatch(const AtlasRegion& region,
+                                const SDL_Rect& destRect) {
+    auto& page          = pages[region.page];
+    auto firstVertex    = (int)page.vertices.size();
+    const auto& rect    = region.rect;
+    const auto addVertex = [&](int x, int y, int u, int v) {
+        page.vertices.push_back(
+            {{(float)x, (float)y},
+             {255, 255, 255, 255},
+             {(float)u / pageSize, (float)v / pageSize}});
+    };
+    addVertex(destRect.x, destRect.y, rect.x, rect.y);
+    addVertex(destRect.x + destRect.w, destRect.y, rect.x + rect.w, rect.y);
+    addVertex(destRect.x + destRect.w, destRect.y + destRect.h,
+              rect.x + rect.w, rect.y + rect.h);
+    addVertex(destRect.x, destRect.y + destRect.h, rect.x, rect.y + rect.h);
+    for (int offset : {0, 1, 2, 0, 2, 3}) {
+        page.indices.push_back(firstVertex + offset);
+    }
+}
+
+void ThumbnailAtlas::drawBatch(const SdlRenderer& renderer) {
+    for (auto& page : pages) {
+        if (!page.indices.empty()) {
+            SDL_RenderGeometry(renderer.get(), page.texture.get(),
+                               page.vertices.data(), (int)page.vertices.size(),
+                               page.indices.data(), (int)page.indices.size());
+        }
+        // The capacity is kept, so the next frames do not allocate
+        page.vertices.clear();
+        page.indices.clear();
+    }
+}
+
+auto ThumbnailAtlas::numPages() const -> int {
+    return layout.numPages();
+}
+
+auto ThumbnailAtlas::getMemory() const -> long {
+    return (long)numPages() * pageSize * pageSize * 4;
+}
+
+auto ThumbnailAtlas::releaseEmptyPages() -> long {
+    long freed = 0;
+    for (int index : layout.releaseEmptyPages()) {
+        pages[index].texture.reset();
+        freed += (long)pageSize * pageSize * 4;
+    }
+    return freed;
+}
+
+auto ThumbnailAtlas::allocate(const SdlRenderer& renderer, int width,
+                              int height) -> std::optional<AtlasRegion> {
+    if (pageSize == 0) {
+        pageSize = std::min(kMaxPageSize, getMaxTextureSize(renderer));
+        layout   = AtlasLayout(pageSize);
+    }
+    if (width > pageSize || height > pageSize) {
+        return std::nullopt;
+    }
+    auto region = layout.allocate(width, height);
+    if (region || !createPage(renderer)) {
+        return region;
+    }
+    return layout.allocate(width, height);
+}
+
+auto ThumbnailAtlas::createPage(const SdlRenderer& renderer) -> bool {
+    // A render target, so the thumbnails scaled in the GPU can be rendered
+    // straight into it
+    SDL_Texture* texture =
+        SDL_CreateTexture(renderer.get(), SDL_PIXELFORMAT_RGBA32,
+                          SDL_TEXTUREACCESS_TARGET, pageSize, pageSize);
+    if (texture == nullptr) {
+        return false;
+    }
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+
+    auto index = (std::size_t)layout.addPage();
+    if (index == pages.size()) {
+        pages.push_back(Page{createTexture(nullptr)});
+    }
+    pages[index].texture = createTexture(texture);
+    // The padding between the regions has to be transparent
+    clearRect(renderer, pages[index], SDL_Rect{0, 0, pageSize, pageSize});
+    return true;
+}
+
+void ThumbnailAtlas::clearRect(const SdlRenderer& renderer, Page& page,
+                               const SDL_Rect& rect) {
+    Uint8 r, g, b, a;
+    SDL_BlendMode blendMode;
+    SDL_GetRenderDrawColor(renderer.get(), &r, &g, &b, &a);
+    SDL_GetRenderDrawBlendMode(renderer.get(), &blendMode);
+
+    SDL_SetRenderTarget(renderer.get(), page.texture.get());
+    SDL_SetRenderDrawColor(renderer.get(), 0, 0, 0, 0);
+    SDL_SetRenderDrawBlendMode(renderer.get(), SDL_BLENDMODE_NONE);
+    SDL_RenderFillRect(renderer.get(), &rect);
+    SDL_SetRenderTarget(renderer.get(), nullptr);
+
+    SDL_SetRenderDrawColor(renderer.get(), r, g, b, a);
+    SDL_SetRenderDrawBlendMode(renderer.get(), blendMode);
+}
@@ -0,0 +1,500 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cacheFilenames.hpp"
+#include "sdlUtils.hpp"
+#include "typesDefinition.hpp"
+
+// Packed on-disk database of downscaled thumbnails, stored in
+// "$XDG_CACHE_HOME/aiv/thumbnails.db". The file is a header followed by
+// records, each one holding the key (path and thumbnail size), the
+// modification time and size of the image, its original dimensions and the
+// RGBA32 pixels of the thumbnail.
+//
+// The file is memory mapped when the store is created, and the index is
+// built by walking the record headers, so lookups never decode anything and
+// the returned surfaces point directly into the mapping. New thumbnails are
+// kept in memory until they add up to a few MB, then they are appended and
+// read from the mapping of the appended bytes. When the file has too many
+// invalidated records, or it grows over the size limit, it is compacted
+// instead by rewriting only the newest live records, down to a fraction of
+// the limit so it is not rewritten again on every flush.
+class ThumbnailStore {
+  public:
+    struct StoredThumbnail {
+        SdlSurface surface;
+        int originalWidth;
+        int originalHeight;
+    };
+
+    ThumbnailStore(long maxBytes) : maxBytes(maxBytes) {
+        const auto aivCache = getAivCacheDirectory();
+        if (aivCache != "") {
+            filename = aivCache + "/thumbnails.db";
+            openMapping();
+        }
+    }
+    ~ThumbnailStore();
+
+    ThumbnailStore(const ThumbnailStore&)                    = delete;
+    auto operator=(const ThumbnailStore&) -> ThumbnailStore& = delete;
+
+    // Returns the stored thumbnail if there is one for this path and size,
+    // and the image has not been modified since it was stored. The surface
+    // is only valid until the next insert or flush.
+    auto find(const std::string& path, int thumbnailSize)
+        -> std::optional<StoredThumbnail>;
+
+    // Does nothing if the thumbnail is already stored and still valid
+    void insert(const std::string& path, int thumbnailSize,
+                SDL_Surface* thumbnail, int originalWidth, int originalHeight);
+
+    void flush();
+
+    // Bytes of the inserted thumbnails that are not written to disk yet
+    auto getPendingBytes() const -> std::size_t;
+
+  private:
+    struct RecordHeader {
+        uint32_t recordSize;
+        uint32_t keyLength;
+        int64_t modificationTime;
+        int64_t fileSize;
+        int32_t originalWidth;
+        int32_t originalHeight;
+        int32_t width;
+        int32_t height;
+    };
+
+    struct Record {
+        RecordHeader header;
+        std::string key;
+        const Uint8* pixels;
+        // Order in which the records were read or inserted, the newest last
+        uint64_t sequence;
+        // Only used by the records that are not written to disk yet
+        std::vector<Uint8> ownedPixels;
+    };
+
+    struct Mapping {
+        const Uint8* address;
+        std::size_t size;
+    };
+
+    // Modification time and size of the image
+    struct FileVersion {
+        int64_t modificationTime;
+        int64_t fileSize;
+    };
+
+    constexpr static char kMagic[4]      = {'A', 'I', 'V', 'T'};
+    constexpr static uint32_t kVersion   = 2;
+    constexpr static std::size_t kHeader = sizeof(kMagic) + sizeof(kVersion);
+    // Compact once this fraction of the file is unreachable records
+    constexpr static double kMaxDeadFraction = 0.25;
+    // A full file is compacted to this fraction of the size limit
+    constexpr static double kCompactedFraction = 0.75;
+    // The pending thumbnails are appended once they take this many bytes
+    constexpr static std::size_t kMaxPendingBytes = 4 * 1024 * 1024;
+
+    static auto makeKey(const std::string& path, int thumbnailSize)
+        -> std::string;
+    static auto getFileVersion(const std::string& path)
+        -> std::optional<FileVersion>;
+    static auto recordSize(uint32_t keyLength, int width, int height)
+        -> std::size_t;
+
+    void openMapping();
+    void closeMappings();
+    // Writes the pending records. With remap, the records read their pixels
+    // from the file afterwards.
+    void writePending(bool remap);
+    void append(int fd, bool remap);
+    void compact();
+    void writeRecord(std::ostream& file, const Record& record);
+    void eraseRecord(const std::string& key);
+
+    std::string filename{""};
+    long maxBytes;
+
+    // The whole file as it was opened, then the appended ranges
+    std::vector<Mapping> mappings;
+
+    std::unordered_map<std::string, Record> records;
+    std::vector<std::string> pendingKeys;
+    std::size_t pendingBytes{0};
+    uint64_t nextSequence{0};
+    std::size_t liveBytes{0};
+    std::size_t deadBytes{0};
+};
+
+//**************************************************************
+//********************* Implementation *************************
+//**************************************************************
+
+ThumbnailStore::~ThumbnailStore() {
+    writePending(false);
+    closeMappings();
+}
+
+auto ThumbnailStore::makeKey(const std::string& path, int thumbnailSize)
+    -> std::string {
+    return std::to_string(thumbnailSize) + ":" + path;
+}
+
+auto ThumbnailStore::getFileVersion(const std::string& path)
+    -> std::optional<FileVersion> {
+    struct stat fileStat;
+    if (stat(path.c_str(), &fileStat) != 0) {
+        return std::nullopt;
+    }
+    return FileVersion{(int64_t)fileStat.st_mtim.tv_sec * 1000000000 +
+                           fileStat.st_mtim.tv_nsec,
+                       (int64_t)fileStat.st_size};
+}
+
+auto ThumbnailStore::recordSize(uint32_t keyLength, int width, int height)
+    -> std::size_t {
+    // Pixels are kept 4 bytes aligned
+    std::size_t keyBytes = (keyLength + 3) & ~(std::size_t)3;
+    return sizeof(RecordHeader) + keyBytes + (std::size_t)width * height * 4;
+}
+
+void ThumbnailStore::openMapping() {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || (std::size_t)fileStat.st_size < kHeader) {
+        // An incomplete file is replaced on the next flush
+        deadBytes = fileStat.st_size;
+        close(fd);
+        return;
+    }
+    void* address =
+        mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+        return;
+    }
+    const auto* mapping     = (const Uint8*)address;
+    std::size_t mappingSize = fileStat.st_size;
+    mappings.push_back({mapping, mappingSize});
+
+    uint32_t version;
+    std::memcpy(&version, mapping + sizeof(kMagic), sizeof(version));
+    if (std::memcmp(mapping, kMagic, sizeof(kMagic)) != 0 ||
+        version != kVersion) {
+        // Unknown format, it will be replaced on the next flush
+        deadBytes = mappingSize;
+        return;
+    }
+
+    std::size_t offset = kHeader;
+    while (offset + sizeof(RecordHeader) <= mappingSize) {
+        Record record;
+        std::memcpy(&record.header, mapping + offset, sizeof(RecordHeader));
+        const auto& header = record.header;
+        if (header.width <= 0 || header.height <= 0 ||
+            header.recordSize !=
+                recordSize(header.keyLength, header.width, header.height) ||
+            offset + header.recordSize > mappingSize) {
+            // Truncated or corrupted tail, drop it
+            break;
+        }
+        const char* keyStart = (const char*)mapping + offset + sizeof(RecordHeader);
+        record.key.assign(keyStart, header.keyLength);
+        record.pixels   = mapping + offset + header.recordSize -
+                        (std::size_t)header.width * header.height * 4;
+        record.sequence = nextSequence++;
+
+        auto it = records.find(record.key);
+        if (it != records.end()) {
+            // Superseded by a newer record of the same key
+            deadBytes += it->second.header.recordSize;
+            liveBytes -= it->second.header.recordSize;
+        }
+        liveBytes += header.recordSize;
+        records[record.key] = std::move(record);
+        offset += header.recordSize;
+    }
+    deadBytes += mappingSize - offset;
+}
+
+void ThumbnailStore::closeMappings() {
+    for (const auto& mapping : mappings) {
+        munmap((void*)mapping.address, mapping.size);
+    }
+    mappings.clear();
+}
+
+void ThumbnailStore::eraseRecord(const std::string& key) {
+    auto it = records.find(key);
+    if (it == records.end()) {
+        return;
+    }
+    const auto& record = it->second;
+    if (record.ownedPixels.empty()) {
+        deadBytes += record.header.recordSize;
+    } else {
+        // Never written, so it takes no space in the file
+        pendingBytes -= record.header.recordSize;
+        pendingKeys.erase(
+            std::find(pendingKeys.begin(), pendingKeys.end(), key));
+    }
+    liveBytes -= record.header.recordSize;
+    records.erase(it);
+}
+
+auto ThumbnailStore::find(const std::string& path, int thumbnailSize)
+    -> std::optional<StoredThumbnail> {
+    auto it = records.find(makeKey(path, thumbnailSize));
+    if (it == records.end()) {
+        return std::nullopt;
+    }
+    auto& record = it->second;
+    auto version = getFileVersion(path);
+    if (!version ||
+        record.header.modificationTime != version.value().modificationTime ||
+        record.header.fileSize != version.value().fileSize) {
+        // The image changed since the thumbnail was stored
+        eraseRecord(it->first);
+        return std::nullopt;
+    }
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom(
+        (void*)record.pixels, record.header.width, record.header.height, 32,
+        record.header.width * 4, SDL_PIXELFORMAT_RGBA32);
+    if (surface == nullptr) {
+        return std::nullopt;
+    }
+    return StoredThumbnail{createSurface(surface), record.header.originalWidth,
+                           record.header.originalHeight};
+}
+
+void ThumbnailStore::insert(const std::string& path, int thumbnailSize,
+                            SDL_Surface* thumbnail, int originalWidth,
+                            int originalHeight) {
+    if (filename == "") {
+        return;
+    }
+    auto version = getFileVersion(path);
+    if (!version) {
+        return;
+    }
+    auto key      = makeKey(path, thumbnailSize);
+    auto existing = records.find(key);
+    if (existing != records.end()) {
+        const auto& header = existing->second.header;
+        if (header.modificationTime == version.value().modificationTime &&
+            header.fileSize == version.value().fileSize) {
+            // Decoded again, like after it was released to fit in the memory
+            // budget, but the stored one is still valid
+            return;
+        }
+        eraseRecord(key);
+    }
+    SDL_Surface* converted =
+        SDL_ConvertSurfaceFormat(thumbnail, SDL_PIXELFORMAT_RGBA32, 0);
+    if (converted == nullptr) {
+        return;
+    }
+    auto rgba = createSurface(converted);
+
+    Record record;
+    record.key    = key;
+    record.header = {(uint32_t)recordSize(record.key.size(), rgba->w, rgba->h),
+                     (uint32_t)record.key.size(),
+                     version.value().modificationTime,
+                     version.value().fileSize,
+                     originalWidth,
+                     originalHeight,
+                     rgba->w,
+                     rgba->h};
+    record.ownedPixels.resize((std::size_t)rgba->w * rgba->h * 4);
+    for (int y = 0; y < rgba->h; ++y) {
+        std::memcpy(record.ownedPixels.data() + (std::size_t)y * rgba->w * 4,
+                    (const Uint8*)rgba->pixels + (std::size_t)y * rgba->pitch,
+                    (std::size_t)rgba->w * 4);
+    }
+    record.pixels   = record.ownedPixels.data();
+    record.sequence = nextSequence++;
+
+    liveBytes += record.header.recordSize;
+    pendingBytes += record.header.recordSize;
+    pendingKeys.push_back(key);
+    records[key] = std::move(record);
+    if (pendingBytes >= kMaxPendingBytes) {
+        flush();
+    }
+}
+
+void ThumbnailStore::flush() {
+    writePending(true);
+}
+
+auto ThumbnailStore::getPendingBytes() const -> std::size_t {
+    return pendingBytes;
+}
+
+void ThumbnailStore::writePending(bool remap) {
+    if (filename == "" || (pendingKeys.empty() && deadBytes == 0)) {
+        return;
+    }
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND, 0600);
+    if (fd < 0) {
+        return;
+    }
+    // Other running instances could be flushing at the same time
+    flock(fd, LOCK_EX);
+
+    std::size_t totalBytes = kHeader + liveBytes + deadBytes;
+    bool compacted         = false;
+    if (deadBytes > kMaxDeadFraction * totalBytes ||
+        totalBytes > (std::size_t)maxBytes) {
+        compact();
+        compacted = true;
+    } else {
+        append(fd, remap);
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+
+    if (compacted && remap) {
+        // The records kept are read from the new file, the rest are gone
+        closeMappings();
+        records.clear();
+        liveBytes = 0;
+        deadBytes = 0;
+        openMapping();
+    }
+    // Whatever could not be written is dropped, it is only a cache
+    for (const auto& key : pendingKeys) {
+        auto it = records.find(key);
+        if (it != records.end() && !it->second.ownedPixels.empty()) {
+            liveBytes -= it->second.header.recordSize;
+            records.erase(it);
+        }
+    }
+    pendingKeys.clear();
+    pendingBytes = 0;
+}
+
+void ThumbnailStore::writeRecord(std::ostream& file, const Record& record) {
+    constexpr static char kPadding[4] = {0, 0, 0, 0};
+    file.write((const char*)&record.header, sizeof(RecordHeader));
+    file.write(record.key.data(), record.key.size());
+    file.write(kPadding, (4 - record.key.size() % 4) % 4);
+    file.write((const char*)record.pixels,
+               (std::size_t)record.header.width * record.header.height * 4);
+}
+
+void ThumbnailStore::append(int fd, bool remap) {
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        return;
+    }
+    // Written through the locked descriptor, so the offsets of the records
+    // are known even if another instance replaced the file
+    std::size_t start = fileStat.st_size;
+    std::ostringstream buffer;
+    if (start == 0) {
+        buffer.write(kMagic, sizeof(kMagic));
+        buffer.write((const char*)&kVersion, sizeof(kVersion));
+        start = kHeader;
+    }
+    for (const auto& key : pendingKeys) {
+        writeRecord(buffer, records.at(key));
+    }
+    const auto bytes = buffer.str();
+    if (write(fd, bytes.data(), bytes.size()) != (ssize_t)bytes.size() ||
+        !remap) {
+        return;
+    }
+
+    // Only the appended bytes are mapped, from the page they start in
+    std::size_t end = fileStat.st_size + bytes.size();
+    std::size_t pageStart =
+        start / (std::size_t)sysconf(_SC_PAGESIZE) * sysconf(_SC_PAGESIZE);
+    void* address = mmap(nullptr, end - pageStart, PROT_READ, MAP_PRIVATE, fd,
+                         (off_t)pageStart);
+    if (address == MAP_FAILED) {
+        return;
+    }
+    mappings.push_back({(const Uint8*)address, end - pageStart});
+
+    std::size_t offset = start - pageStart;
+    for (const auto& key : pendingKeys) {
+        auto& record = records.at(key);
+        record.pixels = (const Uint8*)address + offset +
+                        record.header.recordSize -
+                        (std::size_t)record.header.width *
+                            record.header.height * 4;
+        std::vector<Uint8>().swap(record.ownedPixels);
+        offset += record.header.recordSize;
+    }
+}
+
+void ThumbnailStore::compact() {
+    // Keep the newest records until the size limit
+    std::vector<const Record*> ordered;
+    ordered.reserve(records.size());
+    for (const auto& [key, record] : records) {
+        ordered.push_back(&record);
+    }
+    std::sort(ordered.begin(), ordered.end(), [](const auto* a, const auto* b) {
+        return a->sequence > b->sequence;
+    });
+
+    // Trimmed well under the limit, otherwise a full file would be
+    // rewritten every time a few thumbnails are added
+    auto limit = (std::size_t)maxBytes;
+    if (kHeader + liveBytes > limit) {
+        limit = (std::size_t)(kCompactedFraction * maxBytes);
+    }
+    std::vector<const Record*> kept;
+    std::size_t keptBytes = kHeader;
+    for (const auto* record : ordered) {
+        if (keptBytes + record->header.recordSize > limit) {
+            break;
+        }
+        // Records of deleted images are dropped
+        auto path = record->key.substr(record->key.find(':') + 1);
+        if (!std::filesystem::exists(path)) {
+            continue;
+        }
+        keptBytes += record->header.recordSize;
+        kept.push_back(record);
+    }
+
+    std::string temporaryFilename = filename + ".tmp";
+    {
+        std::ofstream file(temporaryFilename,
+                           std::ios::binary | std::ios::trunc);
+        file.write(kMagic, sizeof(kMagic));
+        file.write((const char*)&kVersion, sizeof(kVersion));
+        for (auto it = kept.rbegin(); it != kept.rend(); ++it) {
+            writeRecord(file, **it);
+        }
+        if (!file) {
+            remove(temporaryFilename.c_str());
+            return;
+        }
+    }
+    rename(temporaryFilename.c_str(), filename.c_str());
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that execute the submitted jobs in FIFO order.
+// Jobs must never touch the SDL renderer, which can only be used from the
+// main thread: they produce surfaces and push them to a ResultQueue that the
+// main thread drains and uploads.
+class WorkerPool {
+  public:
+    WorkerPool(int numThreads) {
+        for (int i = 0; i < numThreads; ++i) {
+            workers.emplace_back([this]() { workerLoop(); });
+        }
+    }
+    ~WorkerPool();
+
+    // Set by the main thread when the job is no longer worth running
+    using CancelFlag = std::shared_ptr<std::atomic<bool>>;
+
+    // A job cancelled before a worker takes it is dropped without running
+    void submit(std::function<void()> job, CancelFlag cancelled = nullptr);
+    auto numThreads() const -> int;
+
+  private:
+    struct Job {
+        std::function<void()> run;
+        CancelFlag cancelled;
+    };
+
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<Job> jobs;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping{false};
+};
+
+// Thread safe queue used by the workers to hand their results to the main
+// thread.
+template<typename T> class ResultQueue {
+  public:
+    void push(T&& value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        values.push_back(std::move(value));
+    }
+
+    auto drain() -> std::vector<T> {
+        std::vector<T> drained;
+        std::lock_guard<std::mutex> lock(mutex);
+        drained.swap(values);
+        return drained;
+    }
+
+  private:
+    std::vector<T> values;
+    std::mutex mutex;
+};
+
+//**************************************************************
+//********************* Implementation *************************
+//**************************************************************
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    condition.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void WorkerPool::submit(std::function<void()> job, CancelFlag cancelled) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back({std::move(job), std::move(cancelled)});
+    }
+    condition.notify_one();
+}
+
+auto WorkerPool::numThreads() const -> int {
+    return (int)workers.size();
+}
+
+void WorkerPool::workerLoop() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [&]() { return stopping || !jobs.empty(); });
+            if (stopping) {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        if (job.cancelled && job.cancelled->load()) {
+            continue;
+        }
+        job.run();
+    }
+}
@@ -12,43 +12,52 @@
 #include "monads.hpp"
 #include <sys/stat.h>
 
+// Returns "$XDG_CACHE_HOME/aiv" (or "$HOME/.cache/aiv"), creating it if
+// needed. Returns an empty string if there is no usable cache directory.
+auto getAivCacheDirectory() -> std::string {
+    using EitherT = Either<std::string, int>;
+
+    const auto loadXdgPath = [](const auto& _) -> EitherT {
+        const char* cache_dirPtr = getenv("XDG_CACHE_HOME");
+        if (cache_dirPtr == nullptr) {
+            return 0;
+        }
+        return std::string(cache_dirPtr);
+    };
+
+    const auto loadDefaultPath = [](const auto& _) -> EitherT {
+        const char* cache_dirPtr = getenv("HOME");
+        if (cache_dirPtr == nullptr) {
+            return 0;
+        }
+        return std::string(cache_dirPtr) + "/.cache";
+    };
+
+    const auto createAivDir = [](const auto& cache_dir) -> std::string {
+        std::string aiv_dir = cache_dir + "/aiv";
+        int mkdir_result    = mkdir(aiv_dir.c_str(), 0700);
+        if (mkdir_result != 0 && errno != EEXIST) {
+            std::cerr << "Error creating directory '" << aiv_dir
+                      << "': " << strerror(errno) << std::endl;
+            return "";
+        }
+        return aiv_dir;
+    };
+
+    const auto cacheDir = EitherT(0) | loadXdgPath | loadDefaultPath;
+    if (std::holds_alternative<std::string>(cacheDir)) {
+        return createAivDir(std::get<std::string>(cacheDir));
+    }
+    return "";
+}
+
 class CacheFilenames {
   public:
     CacheFilenames() {
-        using EitherT = Either<std::string, int>;
-
-        const auto loadXdgPath = [](const auto& _) -> EitherT {
-            const char* cache_dirPtr = getenv("XDG_CACHE_HOME");
-            if (cache_dirPtr == nullptr) {
-                return 0;
-            }
-            return std::string(cache_dirPtr);
-        };
-
-        const auto loadDefaultPath = [](const auto& _) -> EitherT {
-            const char* cache_dirPtr = getenv("HOME");
-            if (cache_dirPtr == nullptr) {
-                return 0;
-            }
-            return std::string(cache_dirPtr) + "/.cache";
-        };
-
-        const auto createAivDir = [](const auto& cache_dir) -> std::string {
-            std::string aiv_dir = cache_dir + "/aiv";
-            int mkdir_result    = mkdir(aiv_dir.c_str(), 0700);
-            if (mkdir_result != 0 && errno != EEXIST) {
-                std::cerr << "Error creating directory '" << aiv_dir
-                          << "': " << strerror(errno) << std::endl;
-                return "";
-            }
-			return aiv_dir;
-        };
-
-		const auto cacheDir = EitherT(0) | loadXdgPath | loadDefaultPath;
-		if(std::holds_alternative<std::string>(cacheDir)){
-			const auto aivCache = createAivDir(std::get<std::string>(cacheDir));
-			filename =  aivCache + "/imageNamesCache";
-		}
+        const auto aivCache = getAivCacheDirectory();
+        if (aivCache != "") {
+            filename = aivCache + "/imageNamesCache";
+        }
     }
     auto existsString(const std::vector<std::string>& vector) -> std::size_t;
     void saveActualImagePosition(const SdlContext& sdlContext);
@@ -54,6 +54,11 @@ void zoomDownViewer(SdlContext& sdlContext, int num);
 
 void toggleContiguousView(SdlContext& sdlContext, int num);
 
+void toggleAnimationPause(SdlContext& sdlContext, int num);
+void nextAnimationFrame(SdlContext& sdlContext, int num);
+void previousAnimationFrame(SdlContext& sdlContext, int num);
+void goToAnimationFrame(SdlContext& sdlContext, int num);
+
 class CommandExecuter {
   public:
     CommandExecuter(ConfigStruct configStruct)
@@ -78,7 +83,11 @@ class CommandExecuter {
                               {"E", fitHeight},
                               {">", rotateRight},
                               {"<", rotateLeft},
-                              {"c", toggleContiguousView}} {
+                              {"c", toggleContiguousView},
+                              {"a", toggleAnimationPause},
+                              {".", nextAnimationFrame},
+                              {",", previousAnimationFrame},
+                              {"F", goToAnimationFrame}} {
 
         const auto identity = [](const auto& arg) { return arg; };
 
@@ -386,3 +395,24 @@ void toggleContiguousView(SdlContext& sdlContext, int num) {
     sdlContext.imageViewerState.panningX = 0;
     sdlContext.contiguousView            = !sdlContext.contiguousView;
 }
+
+void toggleAnimationPause(SdlContext& sdlContext, int num) {
+    sdlContext.imageViewerState.animationPaused =
+        !sdlContext.imageViewerState.animationPaused;
+}
+
+void nextAnimationFrame(SdlContext& sdlContext, int num) {
+    num = num == 0 ? 1 : num;
+    sdlContext.imageViewerState.animationStep += num;
+    sdlContext.imageViewerState.animationPaused = true;
+}
+
+void previousAnimationFrame(SdlContext& sdlContext, int num) {
+    num = num == 0 ? 1 : num;
+    sdlContext.imageViewerState.animationStep -= num;
+    sdlContext.imageViewerState.animationPaused = true;
+}
+
+void goToAnimationFrame(SdlContext& sdlContext, int num) {
+    sdlContext.imageViewerState.animationSeek = num;
+}
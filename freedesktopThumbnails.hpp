@@ -0,0 +1,293 @@
+#pragma once
+
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "md5.hpp"
+#include "sdlUtils.hpp"
+#include "typesDefinition.hpp"
+
+// Support for the shared thumbnails of the freedesktop Thumbnail Managing
+// Standard, the ones file managers keep in "$XDG_CACHE_HOME/thumbnails".
+// Each flavor directory holds PNGs named after the MD5 of the file URI, with
+// "Thumb::URI" and "Thumb::MTime" text chunks to validate them.
+//
+// All the functions are thread safe, they are called from the workers.
+
+struct SharedThumbnail {
+    SdlSurface surface;
+    // 0 when the thumbnail does not store the original dimensions
+    int originalWidth;
+    int originalHeight;
+};
+
+// Returns the shared thumbnail of the smallest flavor that is at least
+// thumbnailSize, if one exists and is up to date.
+auto loadSharedThumbnail(const std::string& filename, int thumbnailSize)
+    -> std::optional<SharedThumbnail>;
+
+// Size of the flavor saved for thumbnailSize. The image passed to
+// saveSharedThumbnail should be at least this big.
+auto sharedThumbnailSize(int thumbnailSize) -> int;
+
+// Writes the shared thumbnail of the flavor used for thumbnailSize from the
+// image, which can be already downscaled.
+void saveSharedThumbnail(const std::string& filename, int thumbnailSize,
+                         SDL_Surface* image, int originalWidth,
+                         int originalHeight);
+
+auto fileToUri(const std::string& filename) -> std::string;
+
+//**************************************************************
+//********************* Implementation *************************
+//**************************************************************
+
+namespace freedesktop {
+
+struct Flavor {
+    const char* directory;
+    int size;
+};
+
+constexpr static std::array<Flavor, 4> kFlavors{{{"normal", 128},
+                                                 {"large", 256},
+                                                 {"x-large", 512},
+                                                 {"xx-large", 1024}}};
+
+auto getThumbnailsDirectory() -> std::string {
+    const char* cacheDir = getenv("XDG_CACHE_HOME");
+    if (cacheDir != nullptr && cacheDir[0] != '\0') {
+        return std::string(cacheDir) + "/thumbnails";
+    }
+    const char* homeDir = getenv("HOME");
+    if (homeDir != nullptr) {
+        return std::string(homeDir) + "/.cache/thumbnails";
+    }
+    return "";
+}
+
+auto crc32(const Uint8* data, std::size_t length, uint32_t crc = 0)
+    -> uint32_t {
+    crc = ~crc;
+    for (std::size_t i = 0; i < length; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+auto readBigEndian32(const Uint8* bytes) -> uint32_t {
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) |
+           ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+}
+
+// Reads the keys and values of the tEXt chunks of a PNG file without
+// decoding the image
+auto readPngTextChunks(const std::string& filename)
+    -> std::unordered_map<std::string, std::string> {
+    constexpr static Uint8 kSignature[8] = {0x89, 'P',  'N',  'G',
+                                            '\r', '\n', 0x1a, '\n'};
+    std::unordered_map<std::string, std::string> texts;
+    std::ifstream file(filename, std::ios::binary);
+    Uint8 signature[8];
+    if (!file.read((char*)signature, 8) ||
+        std::memcmp(signature, kSignature, 8) != 0) {
+        return texts;
+    }
+    Uint8 chunkHeader[8];
+    while (file.read((char*)chunkHeader, 8)) {
+        uint32_t length = readBigEndian32(chunkHeader);
+        std::string type((const char*)chunkHeader + 4, 4);
+        if (type == "IEND") {
+            break;
+        }
+        if (type != "tEXt") {
+            // Skip the data and the CRC
+            file.seekg(length + 4, std::ios::cur);
+            continue;
+        }
+        std::string data(length, '\0');
+        if (!file.read(data.data(), length)) {
+            break;
+        }
+        file.seekg(4, std::ios::cur);
+        auto separator = data.find('\0');
+        if (separator != std::string::npos) {
+            texts[data.substr(0, separator)] = data.substr(separator + 1);
+        }
+    }
+    return texts;
+}
+
+// Inserts tEXt chunks right after the IHDR chunk of a PNG file in memory
+auto addPngTextChunks(const std::string& png,
+                      const std::vector<std::pair<std::string, std::string>>&
+                          texts) -> std::string {
+    constexpr static std::size_t kIhdrEnd = 8 + 8 + 13 + 4;
+    if (png.size() < kIhdrEnd) {
+        return png;
+    }
+    const auto writeBigEndian32 = [](std::string& out, uint32_t value) {
+        out += (char)(value >> 24);
+        out += (char)(value >> 16);
+        out += (char)(value >> 8);
+        out += (char)value;
+    };
+
+    std::string result = png.substr(0, kIhdrEnd);
+    for (const auto& [key, value] : texts) {
+        std::string chunk = "tEXt" + key + '\0' + value;
+        writeBigEndian32(result, (uint32_t)(chunk.size() - 4));
+        result += chunk;
+        writeBigEndian32(result,
+                         crc32((const Uint8*)chunk.data(), chunk.size()));
+    }
+    result += png.substr(kIhdrEnd);
+    return result;
+}
+
+} // namespace freedesktop
+
+auto fileToUri(const std::string& filename) -> std::string {
+    // Same escaping as g_filename_to_uri, which is what file managers use
+    // to name the thumbnails
+    constexpr static char kHexDigits[] = "0123456789ABCDEF";
+    std::error_code error;
+    auto absolutePath = std::filesystem::absolute(filename, error);
+    std::string path =
+        error ? filename : absolutePath.lexically_normal().string();
+
+    std::string uri = "file://";
+    for (unsigned char c : path) {
+        if (std::isalnum(c) || std::strchr("!$&'()*+,-./:=@_~", c) != nullptr) {
+            uri += (char)c;
+        } else {
+            uri += '%';
+            uri += kHexDigits[c >> 4];
+            uri += kHexDigits[c & 0xf];
+        }
+    }
+    return uri;
+}
+
+auto loadSharedThumbnail(const std::string& filename, int thumbnailSize)
+    -> std::optional<SharedThumbnail> {
+    auto thumbnailsDirectory = freedesktop::getThumbnailsDirectory();
+    struct stat fileStat;
+    if (thumbnailsDirectory == "" || stat(filename.c_str(), &fileStat) != 0) {
+        return std::nullopt;
+    }
+    auto uri  = fileToUri(filename);
+    auto name = md5Hex(uri) + ".png";
+
+    for (const auto& flavor : freedesktop::kFlavors) {
+        if (flavor.size < thumbnailSize) {
+            continue;
+        }
+        auto path = thumbnailsDirectory + "/" + flavor.directory + "/" + name;
+        auto texts = freedesktop::readPngTextChunks(path);
+        auto mtime = texts.find("Thumb::MTime");
+        if (mtime == texts.end() ||
+            mtime->second != std::to_string(fileStat.st_mtime)) {
+            continue;
+        }
+        auto storedUri = texts.find("Thumb::URI");
+        if (storedUri != texts.end() && storedUri->second != uri) {
+            continue;
+        }
+
+        SDL_Surface* loaded = IMG_Load(path.c_str());
+        if (loaded == nullptr) {
+            continue;
+        }
+        const auto readDimension = [&](const std::string& key) {
+            auto it = texts.find(key);
+            return it == texts.end() ? 0 : std::atoi(it->second.c_str());
+        };
+        return SharedThumbnail{createSurface(loaded),
+                               readDimension("Thumb::Image::Width"),
+                               readDimension("Thumb::Image::Height")};
+    }
+    return std::nullopt;
+}
+
+auto getSharedThumbnailFlavor(int thumbnailSize)
+    -> const freedesktop::Flavor& {
+    for (const auto& flavor : freedesktop::kFlavors) {
+        if (flavor.size >= thumbnailSize) {
+            return flavor;
+        }
+    }
+    return freedesktop::kFlavors.back();
+}
+
+auto sharedThumbnailSize(int thumbnailSize) -> int {
+    return getSharedThumbnailFlavor(thumbnailSize).size;
+}
+
+void saveSharedThumbnail(const std::string& filename, int thumbnailSize,
+                         SDL_Surface* image, int originalWidth,
+                         int originalHeight) {
+    auto thumbnailsDirectory = freedesktop::getThumbnailsDirectory();
+    struct stat fileStat;
+    if (thumbnailsDirectory == "" || stat(filename.c_str(), &fileStat) != 0) {
+        return;
+    }
+    const auto* flavor = &getSharedThumbnailFlavor(thumbnailSize);
+
+    auto directory = thumbnailsDirectory + "/" + flavor->directory;
+    mkdir(thumbnailsDirectory.c_str(), 0700);
+    mkdir(directory.c_str(), 0700);
+
+    // Images smaller than the flavor are stored with their own size
+    auto size = computeThumbnailSize(image->w, image->h, flavor->size,
+                                     flavor->size);
+    auto thumbnail = downscaleSurface(image, size.x, size.y);
+    if (!thumbnail) {
+        return;
+    }
+
+    auto uri       = fileToUri(filename);
+    auto path      = directory + "/" + md5Hex(uri) + ".png";
+    // Written to a temporary file and renamed, so other programs never see
+    // a partial thumbnail
+    auto temporary = path + "." + std::to_string(getpid()) + "." +
+                     std::to_string(std::hash<std::thread::id>{}(
+                         std::this_thread::get_id())) +
+                     ".tmp";
+    if (IMG_SavePNG(thumbnail.value().get(), temporary.c_str()) != 0) {
+        remove(temporary.c_str());
+        return;
+    }
+    std::string png;
+    {
+        std::ifstream file(temporary, std::ios::binary);
+        png.assign(std::istreambuf_iterator<char>(file),
+                   std::istreambuf_iterator<char>());
+    }
+    png = freedesktop::addPngTextChunks(
+        png, {{"Thumb::URI", uri},
+              {"Thumb::MTime", std::to_string(fileStat.st_mtime)},
+              {"Thumb::Size", std::to_string(fileStat.st_size)},
+              {"Thumb::Image::Width", std::to_string(originalWidth)},
+              {"Thumb::Image::Height", std::to_string(originalHeight)},
+              {"Software", "aiv"}});
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(png.data(), png.size());
+    }
+    chmod(temporary.c_str(), 0600);
+    rename(temporary.c_str(), path.c_str());
+}
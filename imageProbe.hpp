@@ -0,0 +1,351 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "typesDefinition.hpp"
+
+// Reads the dimensions of PNG, JPEG, GIF, BMP and TIFF files from their
+// headers, without decoding any pixel, so the layout can use the real aspect
+// ratios before the images are loaded. Only a few hundred bytes are read per
+// file, except for GIFs and TIFFs, whose frames are counted by skipping over
+// their blocks.
+
+struct ImageProbe {
+    int width{0};
+    int height{0};
+    int numFrames{1};
+    // EXIF orientation, from 1 to 8. The images are displayed without
+    // applying it, so width and height are not swapped.
+    int orientation{1};
+};
+
+// Thread safe. Returns std::nullopt if the format is not recognized or the
+// header is truncated.
+auto probeImage(const std::string& filename) -> std::optional<ImageProbe>;
+
+// Probes every image of the vector, with numThreads threads, and fills its
+// dimensions, frame count and orientation
+void probeImages(std::vector<ImageHeader>& imagesVector, int numThreads);
+
+//**************************************************************
+//********************* Implementation *************************
+//**************************************************************
+
+namespace probe {
+
+// Reads n bytes at the given offset, returns false if they are not there
+using ReadFunction = std::function<bool(std::size_t, Uint8*, std::size_t)>;
+
+auto readBigEndian(const Uint8* bytes, int numBytes) -> uint32_t {
+    uint32_t value = 0;
+    for (int i = 0; i < numBytes; ++i) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+auto readLittleEndian(const Uint8* bytes, int numBytes) -> uint32_t {
+    uint32_t value = 0;
+    for (int i = numBytes - 1; i >= 0; --i) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+// Reads the dimensions and orientation of the first IFD of a TIFF structure,
+// which is also the layout of the EXIF block of JPEGs. With countFrames it
+// follows the chain of IFDs, one per page.
+auto readTiff(const ReadFunction& read, ImageProbe& probe, bool countFrames)
+    -> bool {
+    constexpr static int kMaxFrames = 4096;
+    constexpr static uint32_t kImageWidth   = 256;
+    constexpr static uint32_t kImageLength  = 257;
+    constexpr static uint32_t kOrientation  = 274;
+    constexpr static uint32_t kTypeShort    = 3;
+
+    Uint8 header[8];
+    if (!read(0, header, 8)) {
+        return false;
+    }
+    bool littleEndian = header[0] == 'I' && header[1] == 'I';
+    if (!littleEndian && !(header[0] == 'M' && header[1] == 'M')) {
+        return false;
+    }
+    const auto readValue = [&](const Uint8* bytes, int numBytes) {
+        return littleEndian ? readLittleEndian(bytes, numBytes)
+                            : readBigEndian(bytes, numBytes);
+    };
+
+    std::size_t ifdOffset = readValue(header + 4, 4);
+    std::unordered_set<std::size_t> visited;
+    int numFrames = 0;
+    while (ifdOffset != 0 && numFrames < kMaxFrames &&
+           visited.insert(ifdOffset).second) {
+        Uint8 countBytes[2];
+        if (!read(ifdOffset, countBytes, 2)) {
+            break;
+        }
+        std::size_t numEntries = readValue(countBytes, 2);
+        std::vector<Uint8> entries(numEntries * 12 + 4);
+        if (!read(ifdOffset + 2, entries.data(), entries.size())) {
+            break;
+        }
+        if (numFrames == 0) {
+            for (std::size_t i = 0; i < numEntries; ++i) {
+                const Uint8* entry = entries.data() + i * 12;
+                uint32_t tag       = readValue(entry, 2);
+                uint32_t type      = readValue(entry + 2, 2);
+                // Short values are stored in the first bytes of the field
+                uint32_t value = type == kTypeShort ? readValue(entry + 8, 2)
+                                                    : readValue(entry + 8, 4);
+                if (tag == kImageWidth) {
+                    probe.width = (int)value;
+                } else if (tag == kImageLength) {
+                    probe.height = (int)value;
+                } else if (tag == kOrientation && value >= 1 && value <= 8) {
+                    probe.orientation = (int)value;
+                }
+            }
+        }
+        numFrames += 1;
+        if (!countFrames) {
+            break;
+        }
+        ifdOffset = readValue(entries.data() + numEntries * 12, 4);
+    }
+    probe.numFrames = std::max(numFrames, 1);
+    return numFrames > 0;
+}
+
+auto readPng(std::ifstream& file, ImageProbe& probe) -> bool {
+    // Signature, then the IHDR chunk: length, type, width and height
+    Uint8 header[24];
+    if (!file.read((char*)header, 24) ||
+        std::memcmp(header + 12, "IHDR", 4) != 0) {
+        return false;
+    }
+    probe.width  = (int)readBigEndian(header + 16, 4);
+    probe.height = (int)readBigEndian(header + 20, 4);
+
+    // Animated PNGs declare the number of frames in an acTL chunk, before
+    // the image data
+    file.seekg(8 + 8 + 13 + 4);
+    Uint8 chunk[8];
+    while (file.read((char*)chunk, 8)) {
+        uint32_t length = readBigEndian(chunk, 4);
+        if (std::memcmp(chunk + 4, "IDAT", 4) == 0) {
+            break;
+        }
+        if (std::memcmp(chunk + 4, "acTL", 4) == 0) {
+            Uint8 numFrames[4];
+            if (length >= 4 && file.read((char*)numFrames, 4)) {
+                probe.numFrames =
+                    std::max((int)readBigEndian(numFrames, 4), 1);
+            }
+            break;
+        }
+        // Skip the data and the CRC
+        file.seekg((std::streamoff)length + 4, std::ios::cur);
+    }
+    return true;
+}
+
+auto readJpeg(std::ifstream& file, ImageProbe& probe) -> bool {
+    // The orientation is in the first entries of the EXIF block, so its
+    // beginning is enough
+    constexpr static std::size_t kMaxExifRead = 4096;
+
+    file.seekg(2);
+    Uint8 marker[4];
+    while (file.read((char*)marker, 2)) {
+        if (marker[0] != 0xFF) {
+            return false;
+        }
+        if (marker[1] == 0xFF) {
+            file.seekg(-1, std::ios::cur);
+            continue;
+        }
+        if (marker[1] == 0xD9 || marker[1] == 0xDA ||
+            !file.read((char*)marker + 2, 2)) {
+            return false;
+        }
+        std::size_t length = readBigEndian(marker + 2, 2);
+        if (length < 2) {
+            return false;
+        }
+        std::size_t payloadLength = length - 2;
+        auto payloadStart         = file.tellg();
+
+        bool isStartOfFrame = marker[1] >= 0xC0 && marker[1] <= 0xCF &&
+                              marker[1] != 0xC4 && marker[1] != 0xC8 &&
+                              marker[1] != 0xCC;
+        if (isStartOfFrame) {
+            Uint8 frame[5];
+            if (payloadLength < 5 || !file.read((char*)frame, 5)) {
+                return false;
+            }
+            probe.height = (int)readBigEndian(frame + 1, 2);
+            probe.width  = (int)readBigEndian(frame + 3, 2);
+            return true;
+        }
+        if (marker[1] == 0xE1 && payloadLength > 6) {
+            std::vector<Uint8> exif(std::min(payloadLength, kMaxExifRead));
+            if (file.read((char*)exif.data(), exif.size()) &&
+                std::memcmp(exif.data(), "Exif\0\0", 6) == 0) {
+                ImageProbe exifProbe;
+                readTiff(
+                    [&](std::size_t offset, Uint8* out, std::size_t n) {
+                        if (6 + offset + n > exif.size()) {
+                            return false;
+                        }
+                        std::memcpy(out, exif.data() + 6 + offset, n);
+                        return true;
+                    },
+                    exifProbe, false);
+                probe.orientation = exifProbe.orientation;
+            }
+            file.clear();
+        }
+        file.seekg(payloadStart + (std::streamoff)payloadLength);
+    }
+    return false;
+}
+
+auto readGif(std::ifstream& file, ImageProbe& probe) -> bool {
+    // Header and logical screen descriptor
+    Uint8 header[13];
+    if (!file.read((char*)header, 13)) {
+        return false;
+    }
+    probe.width  = (int)readLittleEndian(header + 6, 2);
+    probe.height = (int)readLittleEndian(header + 8, 2);
+    if (header[10] & 0x80) {
+        file.seekg(3 << ((header[10] & 0x07) + 1), std::ios::cur);
+    }
+
+    const auto skipSubBlocks = [&]() {
+        int length;
+        while ((length = file.get()) > 0) {
+            file.seekg(length, std::ios::cur);
+        }
+    };
+
+    int numFrames = 0;
+    int blockType;
+    while ((blockType = file.get()) != EOF && blockType != 0x3B) {
+        if (blockType == 0x21) {
+            // Extension: label and data sub-blocks
+            file.get();
+            skipSubBlocks();
+        } else if (blockType == 0x2C) {
+            Uint8 descriptor[9];
+            if (!file.read((char*)descriptor, 9)) {
+                break;
+            }
+            if (descriptor[8] & 0x80) {
+                file.seekg(3 << ((descriptor[8] & 0x07) + 1), std::ios::cur);
+            }
+            // LZW minimum code size, then the image data
+            file.get();
+            skipSubBlocks();
+            numFrames += 1;
+        } else {
+            break;
+        }
+    }
+    probe.numFrames = std::max(numFrames, 1);
+    return true;
+}
+
+auto readBmp(std::ifstream& file, ImageProbe& probe) -> bool {
+    Uint8 header[26];
+    if (!file.read((char*)header, 26)) {
+        return false;
+    }
+    uint32_t infoHeaderSize = readLittleEndian(header + 14, 4);
+    if (infoHeaderSize == 12) {
+        // OS/2 BITMAPCOREHEADER, with 16 bit dimensions
+        probe.width  = (int)readLittleEndian(header + 18, 2);
+        probe.height = (int)readLittleEndian(header + 20, 2);
+    } else {
+        probe.width  = (int32_t)readLittleEndian(header + 18, 4);
+        // Negative for top-down bitmaps
+        probe.height = std::abs((int32_t)readLittleEndian(header + 22, 4));
+    }
+    return true;
+}
+
+} // namespace probe
+
+auto probeImage(const std::string& filename) -> std::optional<ImageProbe> {
+    std::ifstream file(filename, std::ios::binary);
+    Uint8 magic[8];
+    if (!file.read((char*)magic, 8)) {
+        return std::nullopt;
+    }
+    file.seekg(0);
+
+    constexpr static Uint8 kPngSignature[8] = {0x89, 'P',  'N',  'G',
+                                               '\r', '\n', 0x1a, '\n'};
+    ImageProbe probe;
+    bool probed = false;
+    if (std::memcmp(magic, kPngSignature, 8) == 0) {
+        probed = probe::readPng(file, probe);
+    } else if (magic[0] == 0xFF && magic[1] == 0xD8) {
+        probed = probe::readJpeg(file, probe);
+    } else if (std::memcmp(magic, "GIF87a", 6) == 0 ||
+               std::memcmp(magic, "GIF89a", 6) == 0) {
+        probed = probe::readGif(file, probe);
+    } else if (magic[0] == 'B' && magic[1] == 'M') {
+        probed = probe::readBmp(file, probe);
+    } else if (std::memcmp(magic, "II*\0", 4) == 0 ||
+               std::memcmp(magic, "MM\0*", 4) == 0) {
+        probed = probe::readTiff(
+            [&](std::size_t offset, Uint8* out, std::size_t n) {
+                file.clear();
+                file.seekg((std::streamoff)offset);
+                return (bool)file.read((char*)out, (std::streamsize)n);
+            },
+            probe, true);
+    }
+    if (!probed || probe.width <= 0 || probe.height <= 0) {
+        return std::nullopt;
+    }
+    return probe;
+}
+
+void probeImages(std::vector<ImageHeader>& imagesVector, int numThreads) {
+    // The work is I/O bound, the threads only hide the latency of the disk
+    std::atomic<std::size_t> nextIndex{0};
+    const auto probeLoop = [&]() {
+        for (std::size_t index = nextIndex++; index < imagesVector.size();
+             index             = nextIndex++) {
+            auto& imageHeader = imagesVector[index];
+            auto probe        = probeImage(imageHeader.fileAdress);
+            if (probe) {
+                imageHeader.width       = probe.value().width;
+                imageHeader.height      = probe.value().height;
+                imageHeader.numFrames   = probe.value().numFrames;
+                imageHeader.orientation = probe.value().orientation;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < numThreads; ++i) {
+        threads.emplace_back(probeLoop);
+    }
+    probeLoop();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+
+#include "sdlUtils.hpp"
+#include "typesDefinition.hpp"
+
+// Drawing an image much smaller than its size samples the full texture with
+// bilinear filtering, which aliases and is slow in the software renderer.
+// The still images get a pyramid of levels downscaled by area averaging, and
+// are drawn from the smallest level that is at least as big as the image on
+// screen, so the filter never reduces more than 2 times.
+
+// Whether the image is big enough to have any level besides itself
+auto hasPyramidLevels(int width, int height) -> bool;
+
+// Thread safe. Returns the image followed by its levels, or an empty vector
+// if cancelled is set before they are finished. The image is not kept in the
+// ImagePyramid, levels[0] is reset before it is stored.
+auto buildPyramidLevels(SdlSurface image,
+                        const std::atomic<bool>* cancelled = nullptr)
+    -> std::vector<SdlSurface>;
+
+// Uploads to imageHeader.image the level to draw the image drawWidth pixels
+// wide, replacing the previous one. If it is the full resolution, it sets
+// needsFullResolution and wakes up the main loop so the loader decodes it.
+void selectPyramidLevel(const SdlRenderer& renderer, ImageHeader& imageHeader,
+                        int drawWidth);
+
+// Bytes of the levels kept in CPU memory
+auto getPyramidMemory(const ImagePyramid& pyramid) -> long;
+
+//**************************************************************
+//********************* Implementation *************************
+//**************************************************************
+
+namespace pyramid {
+// Smaller images are cheap to draw whatever the filter does
+constexpr static int kMinLevelSize = 256;
+} // namespace pyramid
+
+auto hasPyramidLevels(int width, int height) -> bool {
+    return std::max(width, height) / 2 >= pyramid::kMinLevelSize;
+}
+
+auto buildPyramidLevels(SdlSurface image, const std::atomic<bool>* cancelled)
+    -> std::vector<SdlSurface> {
+    std::vector<SdlSurface> levels;
+    levels.push_back(std::move(image));
+    while (hasPyramidLevels(levels.back()->w, levels.back()->h)) {
+        if (cancelled != nullptr && cancelled->load()) {
+            return {};
+        }
+        auto level = downscaleSurface(levels.back().get(),
+                                      levels.back()->w / 2,
+                                      levels.back()->h / 2);
+        if (!level) {
+            break;
+        }
+        levels.push_back(std::move(level.value()));
+    }
+    return levels;
+}
+
+void selectPyramidLevel(const SdlRenderer& renderer, ImageHeader& imageHeader,
+                        int drawWidth) {
+    auto& pyramid = imageHeader.pyramid.value();
+    int level     = 0;
+    while (level + 1 < (int)pyramid.levels.size() &&
+           pyramid.levels[level + 1]->w >= drawWidth) {
+        level += 1;
+    }
+    bool needsFullResolution =
+        level == 0 && !pyramid.levels[0] && pyramid.uploadedLevel != 0;
+    if (needsFullResolution && !pyramid.needsFullResolution) {
+        wakeUpMainLoop();
+    }
+    pyramid.needsFullResolution = needsFullResolution;
+    if (needsFullResolution) {
+        level = 1;
+    }
+    if (level == pyramid.uploadedLevel && imageHeader.image) {
+        return;
+    }
+    SDL_Texture* texture = SDL_CreateTextureFromSurface(
+        renderer.get(), pyramid.levels[level].get());
+    if (texture == nullptr) {
+        // The previous level is still drawn, only less sharp or slower
+        return;
+    }
+    imageHeader.image     = createTexture(texture);
+    pyramid.uploadedLevel = level;
+}
+
+auto getPyramidMemory(const ImagePyramid& pyramid) -> long {
+    long memory = 0;
+    for (const auto& level : pyramid.levels) {
+        if (level) {
+            memory += (long)level->h * level->pitch;
+        }
+    }
+    return memory;
+}
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <csetjmp>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef AIV_USE_LIBJPEG
+#include <jpeglib.h>
+#endif
+
+#include "typesDefinition.hpp"
+
+// Helpers that read the JPEG markers without decoding the image. They only
+// read the segment headers and the APP segments they need, so they cost a
+// few KB of I/O per file. All of them are thread safe.
+
+struct JpegHeader {
+    int width{0};
+    int height{0};
+    // Embedded preview from the EXIF IFD1 or the JFIF JFXX extension, as a
+    // complete JPEG stream. Empty if there is none.
+    std::vector<Uint8> embeddedThumbnail;
+};
+
+// Reads the markers up to the start of frame. Returns std::nullopt if the
+// file is not a JPEG or has no frame header.
+auto readJpegHeader(const std::string& filename) -> std::optional<JpegHeader>;
+
+// Decodes the embedded preview if it is at least minSize pixels in its
+// largest side and has the aspect ratio of the main image (some cameras
+// letterbox it).
+auto loadEmbeddedJpegThumbnail(const JpegHeader& header, int minSize)
+    -> std::optional<SdlSurface>;
+
+#ifdef AIV_USE_LIBJPEG
+// Decodes a JPEG at 1/1, 1/2, 1/4 or 1/8 of its size with the DCT scaling of
+// libjpeg, which skips most of the IDCT work. It picks the smallest scale
+// whose largest side is still at least minSize. The original dimensions are
+// returned in returnWidth and returnHeight. It gives up between two rows
+// once cancelled is set.
+auto loadScaledJpeg(const std::string& filename, int minSize, int& returnWidth,
+                    int& returnHeight,
+                    const std::atomic<bool>* cancelled = nullptr)
+    -> std::optional<SdlSurface>;
+#endif
+
+//**************************************************************
+//********************* Implementation *************************
+//**************************************************************
+
+// Extracts the JPEG thumbnail of the IFD1 of an EXIF block. The data
+// starts at the TIFF header.
+auto readExifThumbnail(const std::vector<Uint8>& tiff) -> std::vector<Uint8> {
+    if (tiff.size() < 8) {
+        return {};
+    }
+    bool littleEndian = tiff[0] == 'I' && tiff[1] == 'I';
+    if (!littleEndian && !(tiff[0] == 'M' && tiff[1] == 'M')) {
+        return {};
+    }
+    const auto read16 = [&](std::size_t offset) -> uint32_t {
+        if (offset + 2 > tiff.size()) {
+            return 0;
+        }
+        return littleEndian ? tiff[offset] | (tiff[offset + 1] << 8)
+                            : (tiff[offset] << 8) | tiff[offset + 1];
+    };
+    const auto read32 = [&](std::size_t offset) -> uint32_t {
+        if (offset + 4 > tiff.size()) {
+            return 0;
+        }
+        return littleEndian ? read16(offset) | (read16(offset + 2) << 16)
+                            : (read16(offset) << 16) | read16(offset + 2);
+    };
+
+    // IFD0 holds the main image tags, it is followed by the IFD1 offset
+    std::size_t ifd0        = read32(4);
+    std::size_t ifd0Entries = read16(ifd0);
+    std::size_t ifd1        = read32(ifd0 + 2 + ifd0Entries * 12);
+    if (ifd1 == 0 || ifd1 >= tiff.size()) {
+        return {};
+    }
+
+    std::size_t thumbnailOffset = 0;
+    std::size_t thumbnailLength = 0;
+    std::size_t ifd1Entries     = read16(ifd1);
+    for (std::size_t i = 0; i < ifd1Entries; ++i) {
+        std::size_t entry = ifd1 + 2 + i * 12;
+        uint32_t tag      = read16(entry);
+        if (tag == 0x0201) {
+            // JPEGInterchangeFormat
+            thumbnailOffset = read32(entry + 8);
+        } else if (tag == 0x0202) {
+            // JPEGInterchangeFormatLength
+            thumbnailLength = read32(entry + 8);
+        }
+    }
+    if (thumbnailOffset == 0 || thumbnailLength < 4 ||
+        thumbnailOffset + thumbnailLength > tiff.size() ||
+        tiff[thumbnailOffset] != 0xFF || tiff[thumbnailOffset + 1] != 0xD8) {
+        return {};
+    }
+    return std::vector<Uint8>(tiff.begin() + thumbnailOffset,
+                              tiff.begin() + thumbnailOffset + thumbnailLength);
+}
+
+auto readJpegHeader(const std::string& filename) -> std::optional<JpegHeader> {
+    std::ifstream file(filename, std::ios::binary);
+    unsigned char soi[2];
+    if (!file.read((char*)soi, 2) || soi[0] != 0xFF || soi[1] != 0xD8) {
+        return std::nullopt;
+    }
+
+    JpegHeader header;
+    unsigned char marker[4];
+    while (file.read((char*)marker, 2)) {
+        if (marker[0] != 0xFF) {
+            return std::nullopt;
+        }
+        if (marker[1] == 0xFF) {
+            // Fill byte
+            file.seekg(-1, std::ios::cur);
+            continue;
+        }
+        if (marker[1] == 0xD9 || marker[1] == 0xDA) {
+            // End of image or start of scan before any frame header
+            return std::nullopt;
+        }
+        if (!file.read((char*)marker + 2, 2)) {
+            return std::nullopt;
+        }
+        int length = (marker[2] << 8) | marker[3];
+        if (length < 2) {
+            return std::nullopt;
+        }
+        std::size_t payloadLength = length - 2;
+
+        bool isStartOfFrame = marker[1] >= 0xC0 && marker[1] <= 0xCF &&
+                              marker[1] != 0xC4 && marker[1] != 0xC8 &&
+                              marker[1] != 0xCC;
+        bool isApp0 = marker[1] == 0xE0;
+        bool isApp1 = marker[1] == 0xE1;
+        if (!isStartOfFrame && !isApp0 && !isApp1) {
+            file.seekg(payloadLength, std::ios::cur);
+            continue;
+        }
+
+        std::vector<Uint8> payload(payloadLength);
+        if (!file.read((char*)payload.data(), payloadLength)) {
+            return std::nullopt;
+        }
+        if (isStartOfFrame) {
+            if (payloadLength < 5) {
+                return std::nullopt;
+            }
+            header.height = (payload[1] << 8) | payload[2];
+            header.width  = (payload[3] << 8) | payload[4];
+            return header;
+        }
+        if (!header.embeddedThumbnail.empty()) {
+            continue;
+        }
+        if (isApp1 && payloadLength > 6 &&
+            std::memcmp(payload.data(), "Exif\0\0", 6) == 0) {
+            header.embeddedThumbnail = readExifThumbnail(
+                std::vector<Uint8>(payload.begin() + 6, payload.end()));
+        } else if (isApp0 && payloadLength > 6 &&
+                   std::memcmp(payload.data(), "JFXX\0", 5) == 0 &&
+                   payload[5] == 0x10) {
+            // JFIF extension with a JPEG coded thumbnail
+            header.embeddedThumbnail.assign(payload.begin() + 6, payload.end());
+        }
+    }
+    return std::nullopt;
+}
+
+auto loadEmbeddedJpegThumbnail(const JpegHeader& header, int minSize)
+    -> std::optional<SdlSurface> {
+    if (header.embeddedThumbnail.empty() || header.width <= 0 ||
+        header.height <= 0) {
+        return std::nullopt;
+    }
+    SDL_RWops* io = SDL_RWFromConstMem(header.embeddedThumbnail.data(),
+                                       (int)header.embeddedThumbnail.size());
+    if (io == nullptr) {
+        return std::nullopt;
+    }
+    SDL_Surface* loaded = IMG_Load_RW(io, 1);
+    if (loaded == nullptr) {
+        return std::nullopt;
+    }
+    SdlSurface thumbnail(loaded, &SDL_FreeSurface);
+
+    constexpr static double kAspectTolerance = 0.02;
+    double imageAspect     = (double)header.width / header.height;
+    double thumbnailAspect = (double)thumbnail->w / thumbnail->h;
+    if (std::max(thumbnail->w, thumbnail->h) < minSize ||
+        std::abs(imageAspect - thumbnailAspect) > kAspectTolerance * imageAspect) {
+        return std::nullopt;
+    }
+    return thumbnail;
+}
+
+#ifdef AIV_USE_LIBJPEG
+struct JpegErrorManager {
+    jpeg_error_mgr manager;
+    std::jmp_buf jump;
+};
+
+auto loadScaledJpeg(const std::string& filename, int minSize, int& returnWidth,
+                    int& returnHeight, const std::atomic<bool>* cancelled)
+    -> std::optional<SdlSurface> {
+    FILE* file = std::fopen(filename.c_str(), "rb");
+    if (file == nullptr) {
+        return std::nullopt;
+    }
+
+    jpeg_decompress_struct decompress;
+    JpegErrorManager error;
+    decompress.err = jpeg_std_error(&error.manager);
+    // The default handler calls exit(), jump back here instead
+    error.manager.error_exit = [](j_common_ptr info) {
+        std::longjmp(((JpegErrorManager*)info->err)->jump, 1);
+    };
+    error.manager.output_message = [](j_common_ptr) {};
+
+    // Only plain pointers live across the setjmp, the surface is freed by
+    // hand if libjpeg fails
+    SDL_Surface* volatile surface = nullptr;
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&decompress);
+        std::fclose(file);
+        SDL_FreeSurface(surface);
+        return std::nullopt;
+    }
+
+    jpeg_create_decompress(&decompress);
+    jpeg_stdio_src(&decompress, file);
+    jpeg_read_header(&decompress, TRUE);
+    returnWidth  = (int)decompress.image_width;
+    returnHeight = (int)decompress.image_height;
+
+    int largestSide = (int)std::max(decompress.image_width,
+                                    decompress.image_height);
+    int denominator = 8;
+    while (denominator > 1 && largestSide / denominator < minSize) {
+        denominator /= 2;
+    }
+    decompress.scale_num           = 1;
+    decompress.scale_denom         = denominator;
+    decompress.out_color_space     = JCS_RGB;
+    decompress.dct_method          = JDCT_IFAST;
+    decompress.do_fancy_upsampling = FALSE;
+    jpeg_start_decompress(&decompress);
+
+    surface = SDL_CreateRGBSurfaceWithFormat(
+        0, (int)decompress.output_width, (int)decompress.output_height, 24,
+        SDL_PIXELFORMAT_RGB24);
+    if (surface == nullptr) {
+        jpeg_destroy_decompress(&decompress);
+        std::fclose(file);
+        return std::nullopt;
+    }
+    while (decompress.output_scanline < decompress.output_height) {
+        if (cancelled != nullptr && cancelled->load()) {
+            jpeg_destroy_decompress(&decompress);
+            std::fclose(file);
+            SDL_FreeSurface(surface);
+            return std::nullopt;
+        }
+        JSAMPROW row = (JSAMPROW)surface->pixels +
+                       (std::size_t)decompress.output_scanline * surface->pitch;
+        jpeg_read_scanlines(&decompress, &row, 1);
+    }
+    jpeg_finish_decompress(&decompress);
+    jpeg_destroy_decompress(&decompress);
+    std::fclose(file);
+    return SdlSurface(surface, &SDL_FreeSurface);
+}
+#endif
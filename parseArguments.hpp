@@ -11,6 +11,7 @@
 #include "cacheFilenames.hpp"
 #include "createFont.hpp"
 #include "filesUtils.hpp"
+#include "imageProbe.hpp"
 #include "sdlUtils.hpp"
 #include "typesDefinition.hpp"
 #include "parseConfig.hpp"
@@ -61,6 +62,12 @@ auto parseCommandLineArguments(int argc, char** argv) -> SdlContext {
         .default_value(false)
         .implicit_value(true);
 
+    parser.add_argument("--writeSharedThumbnails")
+        .help("Save the computed thumbnails in the shared ~/.cache/thumbnails "
+              "directory")
+        .default_value(false)
+        .implicit_value(true);
+
     parser.add_argument("--thumbnailSize")
         .help("The size of the thumbnails")
         .default_value(100);
@@ -69,6 +76,45 @@ auto parseCommandLineArguments(int argc, char** argv) -> SdlContext {
         .help("Change the font size of the bottom bar")
         .default_value(14);
 
+    parser.add_argument("--threads")
+        .help("Number of threads decoding thumbnails. 0 decodes them in the "
+              "main loop")
+        .default_value(sdlContext.loaderSettings.numThreads);
+
+    parser.add_argument("--frameBudget")
+        .help("Milliseconds per frame spent decoding thumbnails with "
+              "--threads 0")
+        .default_value(sdlContext.loaderSettings.frameBudget);
+
+    parser.add_argument("--prefetch")
+        .help("Number of images decoded ahead of the current one in the image "
+              "view, half as many are kept behind")
+        .default_value(sdlContext.loaderSettings.prefetchImages);
+
+    parser.add_argument("--imageCacheSize")
+        .help("Size limit in MB of the decoded images kept in memory after "
+              "leaving the view. 0 unloads them at once")
+        .default_value(512);
+
+    parser.add_argument("--memoryBudget")
+        .help("Size limit in MB of all the decoded thumbnails, images and "
+              "animation frames")
+        .default_value(2048);
+
+    parser.add_argument("--thumbnailCacheSize")
+        .help("Size limit in MB of the thumbnails saved on disk. 0 disables it")
+        .default_value(512);
+
+    parser.add_argument("--stats")
+        .help("Show in the bottom bar the milliseconds it takes to draw it, "
+              "and print their mean and maximum on exit")
+        .default_value(false)
+        .implicit_value(true);
+
+    parser.add_argument("--thumbnailScaling")
+        .help("Where the thumbnails are downscaled: auto, cpu or gpu")
+        .default_value(std::string{"auto"});
+
 
     try {
         parser.parse_known_args(argc, argv);
@@ -85,6 +131,41 @@ auto parseCommandLineArguments(int argc, char** argv) -> SdlContext {
 		auto s = parser.get("--fontSize");
 		sdlContext.style.fontSize = std::stoi(s);
 	}
+    if (parser.is_used("--threads")) {
+        auto s = parser.get("--threads");
+        sdlContext.loaderSettings.numThreads = std::max(0, std::stoi(s));
+    }
+    if (parser.is_used("--frameBudget")) {
+        auto s = parser.get("--frameBudget");
+        sdlContext.loaderSettings.frameBudget = std::max(0, std::stoi(s));
+    }
+    if (parser.is_used("--prefetch")) {
+        auto s = parser.get("--prefetch");
+        sdlContext.loaderSettings.prefetchImages = std::max(0, std::stoi(s));
+    }
+    if (parser.is_used("--imageCacheSize")) {
+        auto s = parser.get("--imageCacheSize");
+        sdlContext.loaderSettings.imageCacheSize =
+            std::max(0L, std::stol(s)) * 1024 * 1024;
+    }
+    if (parser.is_used("--memoryBudget")) {
+        auto s = parser.get("--memoryBudget");
+        sdlContext.loaderSettings.memoryBudget =
+            std::max(0L, std::stol(s)) * 1024 * 1024;
+    }
+    if (parser.is_used("--thumbnailCacheSize")) {
+        auto s = parser.get("--thumbnailCacheSize");
+        sdlContext.loaderSettings.thumbnailStoreSize =
+            std::max(0L, std::stol(s)) * 1024 * 1024;
+    }
+    if (parser.is_used("--thumbnailScaling")) {
+        auto s = parser.get("--thumbnailScaling");
+        if (s == "cpu") {
+            sdlContext.loaderSettings.thumbnailScaling = ThumbnailScaling::Cpu;
+        } else if (s == "gpu") {
+            sdlContext.loaderSettings.thumbnailScaling = ThumbnailScaling::Gpu;
+        }
+    }
 
 
     if (parser["-p"] == true) {
@@ -105,6 +186,12 @@ auto parseCommandLineArguments(int argc, char** argv) -> SdlContext {
     if (parser["-c"] == true) {
         sdlContext.windowSettings.useCacheFile = false;
     }
+    if (parser["--writeSharedThumbnails"] == true) {
+        sdlContext.loaderSettings.writeSharedThumbnails = true;
+    }
+    if (parser["--stats"] == true) {
+        sdlContext.showStats = true;
+    }
 
     return sdlContext;
 }
@@ -148,6 +235,12 @@ auto createSdlContext(int argc, char** argv) -> SdlContext {
 
     auto window   = createSdlWindow(sdlContext.windowSettings);
     auto renderer = createSdlRenderer(window);
+    if (sdlContext.loaderSettings.thumbnailScaling ==
+        ThumbnailScaling::Automatic) {
+        sdlContext.loaderSettings.thumbnailScaling =
+            isSoftwareRenderer(renderer) ? ThumbnailScaling::Cpu
+                                         : ThumbnailScaling::Gpu;
+    }
     auto files    = getFilenamesFromArguments(argc, argv);
     files         = expandInputFiles(files);
 
@@ -165,6 +258,10 @@ auto createSdlContext(int argc, char** argv) -> SdlContext {
         ih.fileAdress = std::move(filename);
         sdlContext.imagesVector.emplace_back(std::move(ih));
     }
+    // Only the headers, so the layout has the real aspect ratios before any
+    // image is decoded
+    probeImages(sdlContext.imagesVector,
+                std::max(sdlContext.loaderSettings.numThreads, 1));
     sdlContext.window   = std::move(window);
     sdlContext.renderer = std::move(renderer);
 
@@ -1,13 +1,18 @@
 #pragma once
 
+#include <atomic>
 #include <filesystem>
+#include <limits>
 #include <sstream>
 
+#include "GifDecoder.hpp"
+#include "jpegUtils.hpp"
 #include "typesDefinition.hpp"
 
 auto createSdlWindow(const WindowSettings& windowSettings) -> SdlWindow;
 auto createSdlRenderer(const SdlWindow& sdlWindow) -> SdlRenderer;
 auto createTexture(SDL_Texture* texture) -> SdlTexture;
+auto createSurface(SDL_Surface* surface) -> SdlSurface;
 
 auto createTexture(const SdlRenderer& renderer, const std::string& filename)
     -> std::optional<SdlTexture>;
@@ -15,15 +20,77 @@ auto createTexture(const SdlRenderer& renderer, const std::string& filename)
 auto createThumbnailWithSize(const SdlRenderer& renderer,
                              const std::string& filename, int maxWidth,
                              int maxHeight, int& returnWidht, int& returnHeight,
-                             long& returnMemory) -> std::optional<SdlTexture>;
+                             long& returnMemory, bool useCpuScaling = false)
+    -> std::optional<SdlTexture>;
 
 auto createThumbnail(const SdlRenderer& renderer, const SdlTexture& texture,
                      int maxWidth, int maxHeight) -> SdlTexture;
 
+auto computeThumbnailSize(int width, int height, int maxWidth, int maxHeight)
+    -> SDL_Point;
+
+// Area-averaging downscale. Every output pixel is the average of the source
+// pixels it covers, weighted by the covered fraction, so there is no aliasing
+// at any reduction ratio. The result is always SDL_PIXELFORMAT_RGBA32.
+auto downscaleSurface(SDL_Surface* source, int newWidth, int newHeight)
+    -> std::optional<SdlSurface>;
+
+auto isSoftwareRenderer(const SdlRenderer& renderer) -> bool;
+
+// Largest side of the textures the renderer can create
+auto getMaxTextureSize(const SdlRenderer& renderer) -> int;
+
+// Bytes of the pixels of the texture, from its size and format
+auto getTextureMemory(SDL_Texture* texture) -> long;
+
+// Thread safe: they only decode and scale in CPU memory, so they can be
+// called from the worker threads.
+auto createThumbnailSurface(SDL_Surface* image, int maxWidth, int maxHeight)
+    -> std::optional<SdlSurface>;
+
+auto loadThumbnailSurface(const std::string& filename, int maxWidth,
+                          int maxHeight, int& returnWidth, int& returnHeight,
+                          long& returnMemory) -> std::optional<SdlSurface>;
+
+// Opens the file for SDL_image with every read failing once cancelled is set,
+// so the decoders give up in the middle of the image instead of finishing it.
+// The returned SDL_RWops closes the file when it is closed.
+auto openCancellableFile(const std::string& filename,
+                         const std::atomic<bool>* cancelled) -> SDL_RWops*;
+
+// Like IMG_Load, but it stops as soon as cancelled is set
+auto loadSurface(const std::string& filename,
+                 const std::atomic<bool>* cancelled = nullptr)
+    -> std::optional<SdlSurface>;
+
 auto memoryToHumanReadable(long bytes, int decimalPrecision = 2) -> std::string;
 
+// Type of the event that wakes up the main loop while it waits for input
+auto getWakeUpEventType() -> Uint32;
+// Thread safe, so the workers can tell the main loop there are results
+void wakeUpMainLoop();
+
+// Opens the animation and decodes its first frame, the rest are decoded by
+// advanceAnimation while it plays
 auto loadGifAnimation(SdlRenderer& renderer, ImageHeader& imageHeader) -> bool;
 
+// Moves to the frame that is due at now, a SDL_GetPerformanceCounter value,
+// from the delay of each frame. It also decodes the frames ahead that are
+// missing.
+void advanceAnimation(SdlAnimation& animation, Uint64 now);
+
+// SDL_GetPerformanceCounter value when the next frame is due, 0 if the
+// animation has a single frame
+auto getAnimationDeadline(const SdlAnimation& animation) -> Uint64;
+
+// Shows the frame with that index, composed again from the nearest
+// checkpoint of the decoder. The frames ahead are decoded from there.
+auto seekAnimation(SdlAnimation& animation, int index) -> bool;
+
+// Bytes of the texture, the changed areas of the frames decoded ahead and
+// the decoder
+auto getAnimationMemory(const SdlAnimation& animation) -> long;
+
 //**************************************************************
 //********************* Implementation *************************
 //**************************************************************
@@ -31,7 +98,46 @@ auto loadGifAnimation(SdlRenderer& renderer, ImageHeader& imageHeader) -> bool;
 auto createThumbnailWithSize(const SdlRenderer& renderer,
                              const std::string& filename, int maxWidth,
                              int maxHeight, int& returnWidht, int& returnHeight,
-                             long& returnMemory) -> std::optional<SdlTexture> {
+                             long& returnMemory, bool useCpuScaling)
+    -> std::optional<SdlTexture> {
+#ifdef AIV_USE_LIBJPEG
+    // JPEGs are decoded at the smallest DCT scale that is still bigger than
+    // the thumbnail, instead of uploading the full image
+    auto scaled = loadScaledJpeg(filename, std::max(maxWidth, maxHeight),
+                                 returnWidht, returnHeight);
+    if (scaled) {
+        std::error_code error;
+        auto fileSize  = std::filesystem::file_size(filename, error);
+        returnMemory   = error ? 0 : (long)fileSize;
+        auto thumbnail = createThumbnailSurface(scaled.value().get(), maxWidth,
+                                                maxHeight);
+        if (!thumbnail) {
+            return std::nullopt;
+        }
+        SDL_Texture* texture = SDL_CreateTextureFromSurface(
+            renderer.get(), thumbnail.value().get());
+        if (texture == nullptr) {
+            return std::nullopt;
+        }
+        return createTexture(texture);
+    }
+#endif
+    if (useCpuScaling) {
+        // Only the thumbnail sized pixels reach the renderer
+        auto surface = loadThumbnailSurface(filename, maxWidth, maxHeight,
+                                            returnWidht, returnHeight,
+                                            returnMemory);
+        if (!surface) {
+            return std::nullopt;
+        }
+        SDL_Texture* texture =
+            SDL_CreateTextureFromSurface(renderer.get(), surface.value().get());
+        if (texture == nullptr) {
+            return std::nullopt;
+        }
+        return createTexture(texture);
+    }
+
     auto texture = createTexture(renderer, filename);
     if (!texture) {
         return std::nullopt;
@@ -53,20 +159,12 @@ auto createThumbnail(const SdlRenderer& renderer, const SdlTexture& texture,
     SDL_QueryTexture(originalTexture, nullptr, nullptr, &w, &h);
 
     // Calculate the new dimensions for the resized texture
-    int newW, newH;
-    if (w > h) {
-        // Landscape image
-        newW = maxWidth;
-        newH = (h * maxWidth) / w;
-    } else {
-        // Portrait or square image
-        newW = (w * maxHeight) / h;
-        newH = maxHeight;
-    }
+    auto newSize = computeThumbnailSize(w, h, maxWidth, maxHeight);
+
     // Create the resized texture
     SDL_Texture* resizedTexture =
         SDL_CreateTexture(renderer.get(), SDL_PIXELFORMAT_RGBA8888,
-                          SDL_TEXTUREACCESS_TARGET, newW, newH);
+                          SDL_TEXTUREACCESS_TARGET, newSize.x, newSize.y);
 
     // Copy the original texture to the resized texture, maintaining the
     // aspect ratio
@@ -77,12 +175,239 @@ auto createThumbnail(const SdlRenderer& renderer, const SdlTexture& texture,
     return createTexture(resizedTexture);
 }
 
+auto computeThumbnailSize(int width, int height, int maxWidth, int maxHeight)
+    -> SDL_Point {
+    SDL_Point newSize;
+    if (width > height) {
+        // Landscape image
+        newSize.x = maxWidth;
+        newSize.y = (height * maxWidth) / width;
+    } else {
+        // Portrait or square image
+        newSize.x = (width * maxHeight) / height;
+        newSize.y = maxHeight;
+    }
+    newSize.x = std::max(newSize.x, 1);
+    newSize.y = std::max(newSize.y, 1);
+    return newSize;
+}
+
+auto loadThumbnailSurface(const std::string& filename, int maxWidth,
+                          int maxHeight, int& returnWidth, int& returnHeight,
+                          long& returnMemory) -> std::optional<SdlSurface> {
+    SDL_Surface* loaded = IMG_Load(filename.c_str());
+    if (loaded == nullptr) {
+        return std::nullopt;
+    }
+    auto original = createSurface(loaded);
+
+    std::error_code error;
+    auto fileSize = std::filesystem::file_size(filename, error);
+    returnMemory  = error ? 0 : (long)fileSize;
+    returnWidth   = original->w;
+    returnHeight  = original->h;
+
+    return createThumbnailSurface(original.get(), maxWidth, maxHeight);
+}
+
+auto openCancellableFile(const std::string& filename,
+                         const std::atomic<bool>* cancelled) -> SDL_RWops* {
+    SDL_RWops* file = SDL_RWFromFile(filename.c_str(), "rb");
+    if (file == nullptr) {
+        return nullptr;
+    }
+    SDL_RWops* io = SDL_AllocRW();
+    if (io == nullptr) {
+        SDL_RWclose(file);
+        return nullptr;
+    }
+    io->type                 = SDL_RWOPS_UNKNOWN;
+    io->hidden.unknown.data1 = file;
+    io->hidden.unknown.data2 = (void*)cancelled;
+
+    const static auto getFile = [](SDL_RWops* context) {
+        return (SDL_RWops*)context->hidden.unknown.data1;
+    };
+    io->size = [](SDL_RWops* context) -> Sint64 {
+        return SDL_RWsize(getFile(context));
+    };
+    io->seek = [](SDL_RWops* context, Sint64 offset, int whence) -> Sint64 {
+        return SDL_RWseek(getFile(context), offset, whence);
+    };
+    io->read = [](SDL_RWops* context, void* ptr, size_t size,
+                  size_t maxnum) -> size_t {
+        // The decoders read in blocks of a few KB, so they stop a few rows
+        // after the flag is set
+        auto* flag = (const std::atomic<bool>*)context->hidden.unknown.data2;
+        if (flag != nullptr && flag->load()) {
+            SDL_SetError("Decoding cancelled");
+            return 0;
+        }
+        return SDL_RWread(getFile(context), ptr, size, maxnum);
+    };
+    io->write = [](SDL_RWops*, const void*, size_t, size_t) -> size_t {
+        return 0;
+    };
+    io->close = [](SDL_RWops* context) -> int {
+        int result = SDL_RWclose(getFile(context));
+        SDL_FreeRW(context);
+        return result;
+    };
+    return io;
+}
+
+auto loadSurface(const std::string& filename,
+                 const std::atomic<bool>* cancelled)
+    -> std::optional<SdlSurface> {
+    SDL_RWops* io = openCancellableFile(filename, cancelled);
+    if (io == nullptr) {
+        return std::nullopt;
+    }
+    // The extension is passed as the type, like IMG_Load does, for the
+    // formats without a signature
+    auto extension = std::filesystem::path(filename).extension().string();
+    if (!extension.empty()) {
+        extension.erase(0, 1);
+    }
+    SDL_Surface* loaded = IMG_LoadTyped_RW(io, 1, extension.c_str());
+    if (loaded == nullptr) {
+        return std::nullopt;
+    }
+    if (cancelled != nullptr && cancelled->load()) {
+        // Some decoders return the rows read so far instead of failing
+        SDL_FreeSurface(loaded);
+        return std::nullopt;
+    }
+    return createSurface(loaded);
+}
+
+auto createThumbnailSurface(SDL_Surface* image, int maxWidth, int maxHeight)
+    -> std::optional<SdlSurface> {
+    auto newSize = computeThumbnailSize(image->w, image->h, maxWidth, maxHeight);
+    return downscaleSurface(image, newSize.x, newSize.y);
+}
+
+auto downscaleSurface(SDL_Surface* source, int newWidth, int newHeight)
+    -> std::optional<SdlSurface> {
+    struct Contribution {
+        int sourceIndex;
+        float weight;
+    };
+
+    // For every output coordinate, the source coordinates it covers and the
+    // fraction of each one that is covered
+    const auto computeContributions = [](int sourceSize, int outputSize) {
+        std::vector<std::vector<Contribution>> contributions(outputSize);
+        double scale = (double)sourceSize / outputSize;
+        for (int i = 0; i < outputSize; ++i) {
+            double begin = i * scale;
+            double end   = std::min((i + 1) * scale, (double)sourceSize);
+            for (int j = (int)begin; j < end; ++j) {
+                double covered = std::min(end, j + 1.) - std::max(begin, (double)j);
+                if (covered > 0) {
+                    contributions[i].push_back(
+                        {j, (float)(covered / (end - begin))});
+                }
+            }
+        }
+        return contributions;
+    };
+
+    SDL_Surface* converted =
+        SDL_ConvertSurfaceFormat(source, SDL_PIXELFORMAT_RGBA32, 0);
+    if (converted == nullptr) {
+        return std::nullopt;
+    }
+    auto rgba = createSurface(converted);
+
+    newWidth         = std::clamp(newWidth, 1, rgba->w);
+    newHeight        = std::clamp(newHeight, 1, rgba->h);
+    SDL_Surface* out = SDL_CreateRGBSurfaceWithFormat(0, newWidth, newHeight,
+                                                      32, SDL_PIXELFORMAT_RGBA32);
+    if (out == nullptr) {
+        return std::nullopt;
+    }
+    auto result = createSurface(out);
+
+    auto columns = computeContributions(rgba->w, newWidth);
+    auto rows    = computeContributions(rgba->h, newHeight);
+
+    // The colors are averaged premultiplied by alpha, so transparent pixels
+    // do not bleed their color into the result
+    std::vector<float> accumulator(newWidth * 4);
+    for (int y = 0; y < newHeight; ++y) {
+        std::fill(accumulator.begin(), accumulator.end(), 0.f);
+        for (const auto& row : rows[y]) {
+            const auto* sourceRow = (const Uint8*)rgba->pixels +
+                                    (std::size_t)row.sourceIndex * rgba->pitch;
+            for (int x = 0; x < newWidth; ++x) {
+                float* acc = &accumulator[x * 4];
+                for (const auto& column : columns[x]) {
+                    const Uint8* pixel = sourceRow + column.sourceIndex * 4;
+                    float weight       = row.weight * column.weight;
+                    float alpha        = pixel[3] * weight;
+                    acc[0] += pixel[0] * alpha;
+                    acc[1] += pixel[1] * alpha;
+                    acc[2] += pixel[2] * alpha;
+                    acc[3] += alpha;
+                }
+            }
+        }
+        auto* outRow = (Uint8*)result->pixels + (std::size_t)y * result->pitch;
+        for (int x = 0; x < newWidth; ++x) {
+            const float* acc = &accumulator[x * 4];
+            Uint8* pixel     = outRow + x * 4;
+            if (acc[3] <= 0.f) {
+                pixel[0] = pixel[1] = pixel[2] = pixel[3] = 0;
+                continue;
+            }
+            pixel[0] = (Uint8)std::clamp(acc[0] / acc[3] + 0.5f, 0.f, 255.f);
+            pixel[1] = (Uint8)std::clamp(acc[1] / acc[3] + 0.5f, 0.f, 255.f);
+            pixel[2] = (Uint8)std::clamp(acc[2] / acc[3] + 0.5f, 0.f, 255.f);
+            pixel[3] = (Uint8)std::clamp(acc[3] + 0.5f, 0.f, 255.f);
+        }
+    }
+    return result;
+}
+
+auto getTextureMemory(SDL_Texture* texture) -> long {
+    Uint32 format;
+    int width, height;
+    if (SDL_QueryTexture(texture, &format, nullptr, &width, &height) != 0) {
+        return 0;
+    }
+    // Formats without a size, like the YUV ones, are counted as 4 bytes
+    long bytesPerPixel = SDL_BYTESPERPIXEL(format);
+    return (long)width * height * (bytesPerPixel > 0 ? bytesPerPixel : 4);
+}
+
+auto isSoftwareRenderer(const SdlRenderer& renderer) -> bool {
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer.get(), &info) != 0) {
+        return false;
+    }
+    return (info.flags & SDL_RENDERER_SOFTWARE) != 0;
+}
+
+auto getMaxTextureSize(const SdlRenderer& renderer) -> int {
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer.get(), &info) != 0 ||
+        info.max_texture_width <= 0 || info.max_texture_height <= 0) {
+        // The software renderer has no limit
+        return std::numeric_limits<int>::max();
+    }
+    return std::min(info.max_texture_width, info.max_texture_height);
+}
+
 auto createSdlWindow(const WindowSettings& windowSettings) -> SdlWindow {
     if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
         std::string error{"Error initializing SDL: "};
         error += SDL_GetError();
         throw std::runtime_error{error};
     }
+    // Initialize the decoders up front, they are later used concurrently by
+    // the thumbnail workers
+    IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG | IMG_INIT_TIF);
 
     unsigned int flags{0};
 
@@ -112,6 +437,11 @@ auto createSdlWindow(const WindowSettings& windowSettings) -> SdlWindow {
 auto createSdlRenderer(const SdlWindow& sdlWindow) -> SdlRenderer {
     auto renderer =
         SDL_CreateRenderer(sdlWindow.get(), -1, SDL_RENDERER_ACCELERATED);
+    if (!renderer) {
+        // Machines without a GPU only have the software renderer
+        renderer =
+            SDL_CreateRenderer(sdlWindow.get(), -1, SDL_RENDERER_SOFTWARE);
+    }
     if (!renderer) {
         std::string error{"Error creating renderer: "};
         error += SDL_GetError();
@@ -126,6 +456,10 @@ auto createTexture(SDL_Texture* texture) -> SdlTexture {
 	return {texture, &SDL_DestroyTexture};
 }
 
+auto createSurface(SDL_Surface* surface) -> SdlSurface {
+    return {surface, &SDL_FreeSurface};
+}
+
 auto createTexture(const SdlRenderer& renderer, const std::string& filename)
     -> std::optional<SdlTexture> {
     auto tex = IMG_LoadTexture(renderer.get(), filename.c_str());
@@ -162,49 +496,151 @@ auto memoryToHumanReadable(long bytes, int decimalPrecision) -> std::string {
     return ss.str();
 }
 
+void pushAnimationFrame(SdlAnimation& animation) {
+    auto& decoder     = *animation.decoder;
+    SDL_Rect rect     = decoder.takeDirtyRect();
+    std::size_t pitch = (std::size_t)rect.w * 4;
+    std::vector<Uint8> pixels(pitch * rect.h);
+    std::size_t canvasPitch = (std::size_t)decoder.getWidth() * 4;
+    const Uint8* source     = decoder.getCanvas() +
+                          (std::size_t)rect.y * canvasPitch +
+                          (std::size_t)rect.x * 4;
+    for (int y = 0; y < rect.h; ++y) {
+        std::memcpy(pixels.data() + y * pitch, source + y * canvasPitch,
+                    pitch);
+    }
+    animation.frames.push_back({rect, std::move(pixels),
+                                decoder.getFrameIndex(),
+                                decoder.getFrameDelay()});
+}
+
+auto getWakeUpEventType() -> Uint32 {
+    static const Uint32 type = SDL_RegisterEvents(1);
+    return type;
+}
+
+void wakeUpMainLoop() {
+    SDL_Event event{};
+    event.type = getWakeUpEventType();
+    SDL_PushEvent(&event);
+}
+
+auto decodeAnimationFrame(SdlAnimation& animation) -> bool {
+    auto& decoder = *animation.decoder;
+    if (!decoder.decodeNextFrame()) {
+        // Loops back to the first frame, unless there is only one
+        if (decoder.getFrameIndex() <= 0 || !decoder.seekToFrame(0)) {
+            return false;
+        }
+    }
+    pushAnimationFrame(animation);
+    return true;
+}
+
+// Copies the changed area of the first frame of the ring to the texture,
+// which has the previous frame
+void showAnimationFrame(SdlAnimation& animation) {
+    auto& frame = animation.frames.front();
+    if (frame.rect.w > 0 && frame.rect.h > 0) {
+        SDL_UpdateTexture(animation.texture.get(), &frame.rect,
+                          frame.pixels.data(), frame.rect.w * 4);
+    }
+    // Only needed until it is in the texture
+    std::vector<Uint8>().swap(frame.pixels);
+    animation.actualFrame = frame.index;
+}
+
+auto getFrameDuration(const AnimationFrame& frame) -> Uint64 {
+    // Like the browsers, which most gifs are made for, delays of 10 ms or
+    // less are played as 100 ms
+    int delay = frame.delay <= 10 ? 100 : frame.delay;
+    return SDL_GetPerformanceFrequency() * (Uint64)delay / 1000;
+}
+
+void advanceAnimation(SdlAnimation& animation, Uint64 now) {
+    // Frames decoded ahead of the one on screen, so a slow frame does not
+    // delay the next one
+    constexpr static std::size_t kAnimationFrames = 4;
+
+    // Started now, or not drawn for a while, like when it was scrolled out
+    // of the contiguous view. It goes on from the frame it was left at
+    // instead of skipping through the frames it missed.
+    if (animation.nextFrameTime == 0 ||
+        now > animation.nextFrameTime + SDL_GetPerformanceFrequency()) {
+        animation.nextFrameTime =
+            now + getFrameDuration(animation.frames.front());
+    }
+    while (now >= animation.nextFrameTime) {
+        if (animation.frames.size() < 2 && !decodeAnimationFrame(animation)) {
+            break;
+        }
+        animation.frames.pop_front();
+        showAnimationFrame(animation);
+        // From the previous deadline, so the delays do not accumulate the
+        // time the loop wakes up late
+        animation.nextFrameTime += getFrameDuration(animation.frames.front());
+    }
+    while (animation.frames.size() < kAnimationFrames &&
+           decodeAnimationFrame(animation)) {
+    }
+}
+
+auto getAnimationDeadline(const SdlAnimation& animation) -> Uint64 {
+    if (animation.frames.size() < 2) {
+        return 0;
+    }
+    return animation.nextFrameTime;
+}
+
+auto seekAnimation(SdlAnimation& animation, int index) -> bool {
+    // Past the end the decoder is left at the last frame, which is shown
+    // instead, so the frames ahead still follow the one on screen. The whole
+    // canvas is dirty after a seek.
+    bool found = animation.decoder->seekToFrame(index);
+    animation.frames.clear();
+    pushAnimationFrame(animation);
+    showAnimationFrame(animation);
+    animation.nextFrameTime = 0;
+    return found;
+}
+
+auto getAnimationMemory(const SdlAnimation& animation) -> long {
+    long memory = animation.decoder->getMemory() +
+                  getTextureMemory(animation.texture.get());
+    for (const auto& frame : animation.frames) {
+        memory += (long)frame.pixels.capacity();
+    }
+    return memory;
+}
+
 auto loadGifAnimation(SdlRenderer& renderer, ImageHeader& imageHeader) -> bool {
-    // Check if the file is a GIF
-    SDL_RWops* io = SDL_RWFromFile(imageHeader.fileAdress.c_str(), "rb");
-    if (io == nullptr) {
+    auto decoder = GifDecoder::open(imageHeader.fileAdress);
+    if (!decoder) {
         return false;
     }
-    if (IMG_isGIF(io) == 0) {
-        // File is not a GIF, return
+    SdlAnimation animation;
+    animation.decoder =
+        std::make_shared<GifDecoder>(std::move(decoder.value()));
+    // Streaming, since every frame updates the area it changes
+    SDL_Texture* texture = SDL_CreateTexture(
+        renderer.get(), SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING,
+        animation.decoder->getWidth(), animation.decoder->getHeight());
+    if (texture == nullptr) {
         return false;
     }
-
-    // Load the GIF animation
-    IMG_Animation* gifAnimation =
-        IMG_LoadAnimation(imageHeader.fileAdress.c_str());
-    if (gifAnimation == nullptr) {
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    animation.texture = createTexture(texture);
+    // Playback starts with the first frame, the rest are decoded while it
+    // plays
+    if (!decodeAnimationFrame(animation)) {
         return false;
     }
+    showAnimationFrame(animation);
 
-    // Create an SdlAnimation object to store the frames and FPS of the GIF
-    // animation
-    SdlAnimation animation;
-    //   animation.fps = gifAnimation->fps;
-
-    animation.fps = std::round(
-        std::clamp((1. / (*gifAnimation->delays * 0.001)), 1., 100.));
-    // Convert each frame of the GIF animation to an SdlTexture and add it to
-    // the SdlAnimation object
-    for (int i = 0; i < gifAnimation->count; i++) {
-        SDL_Surface* surface = gifAnimation->frames[i];
-        SdlTexture texture(
-            SDL_CreateTextureFromSurface(renderer.get(), surface),
-            SDL_DestroyTexture);
-        animation.frames.push_back(std::move(texture));
-    }
-
-    // Update the width, height, and animation fields of the ImageHeader object
-    imageHeader.width     = gifAnimation->w;
-    imageHeader.height    = gifAnimation->h;
+    imageHeader.width     = animation.decoder->getWidth();
+    imageHeader.height    = animation.decoder->getHeight();
     imageHeader.animation = std::move(animation);
     imageHeader.memory =
         std::filesystem::file_size(imageHeader.fileAdress.c_str());
-
-    // Free the IMG_Animation object
-    IMG_FreeAnimation(gifAnimation);
     return true;
 }
@@ -0,0 +1,108 @@
+#include <cassert>
+#include <vector>
+
+#include "AtlasLayout.hpp"
+
+auto overlaps(const SDL_Rect& a, const SDL_Rect& b) -> bool {
+    return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h &&
+           b.y < a.y + a.h;
+}
+
+auto contains(const SDL_Rect& outer, const SDL_Rect& inner) -> bool {
+    return inner.x >= outer.x && inner.y >= outer.y &&
+           inner.x + inner.w <= outer.x + outer.w &&
+           inner.y + inner.h <= outer.y + outer.h;
+}
+
+// Test function for AtlasLayout
+void testAtlasLayout() {
+    // Test 1: A page takes regions until it is full, and they never overlap
+    {
+        AtlasLayout layout(64);
+        assert(!layout.allocate(15, 15));
+        assert(layout.addPage() == 0);
+        // With the padding, 4 shelves of 4 regions
+        std::vector<SDL_Rect> rects;
+        for (int i = 0; i < 16; ++i) {
+            auto region = layout.allocate(15, 15);
+            assert(region);
+            assert(region.value().page == 0);
+            assert(contains({0, 0, 64, 64}, region.value().rect));
+            for (const auto& rect : rects) {
+                assert(!overlaps(rect, region.value().rect));
+            }
+            rects.push_back(region.value().rect);
+        }
+        assert(!layout.allocate(15, 15));
+        assert(!layout.allocate(65, 1));
+        assert(layout.numPages() == 1);
+    }
+
+    // Test 2: An erased region is reused by smaller ones, and the rest of it
+    // is split so all of it is used before anything else
+    {
+        AtlasLayout layout(64);
+        layout.addPage();
+        auto big = layout.allocate(31, 31);
+        assert(big);
+        // Keeps the page from being empty once the big one is erased
+        auto other = layout.allocate(15, 15);
+        assert(other);
+        SDL_Rect cleared = layout.erase(big.value());
+        assert(cleared.x == 0 && cleared.y == 0);
+        assert(cleared.w == 32 && cleared.h == 32);
+
+        std::vector<SDL_Rect> rects{other.value().rect};
+        for (int i = 0; i < 4; ++i) {
+            auto region = layout.allocate(15, 15);
+            assert(region);
+            assert(contains(cleared, region.value().rect));
+            for (const auto& rect : rects) {
+                assert(!overlaps(rect, region.value().rect));
+            }
+            rects.push_back(region.value().rect);
+        }
+        auto next = layout.allocate(15, 15);
+        assert(next);
+        assert(!overlaps(cleared, next.value().rect));
+    }
+
+    // Test 3: The empty pages are released except one, and the slot of a
+    // released page is reused by the next one added
+    {
+        AtlasLayout layout(64);
+        std::vector<AtlasRegion> regions;
+        for (int page = 0; page < 3; ++page) {
+            assert(layout.addPage() == page);
+            // A single region fills the page
+            auto region = layout.allocate(63, 63);
+            assert(region);
+            assert(region.value().page == page);
+            regions.push_back(region.value());
+        }
+        assert(layout.releaseEmptyPages().empty());
+
+        SDL_Rect cleared = layout.erase(regions[0]);
+        assert(cleared.w == 64 && cleared.h == 64);
+        layout.erase(regions[2]);
+        assert(layout.releaseEmptyPages() == std::vector<int>{2});
+        assert(layout.numPages() == 2);
+
+        // The page kept empty starts over
+        auto region = layout.allocate(63, 63);
+        assert(region);
+        assert(region.value().page == 0);
+        assert(region.value().rect.x == 0 && region.value().rect.y == 0);
+        assert(!layout.allocate(63, 63));
+        assert(layout.addPage() == 2);
+        assert(layout.numPages() == 3);
+        region = layout.allocate(63, 63);
+        assert(region);
+        assert(region.value().page == 2);
+    }
+}
+
+int main() {
+    testAtlasLayout();
+    return 0;
+}
@@ -0,0 +1,140 @@
+#include <cassert>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "freedesktopThumbnails.hpp"
+#include "testUtils.hpp"
+
+// 1x1 RGBA PNG
+const std::vector<Uint8> kTestPng{
+    0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A, 0x00, 0x00, 0x00, 0x0D,
+    0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01,
+    0x08, 0x06, 0x00, 0x00, 0x00, 0x1F, 0x15, 0xC4, 0x89, 0x00, 0x00, 0x00,
+    0x0D, 0x49, 0x44, 0x41, 0x54, 0x78, 0x9C, 0x63, 0xF8, 0xCF, 0xC0, 0xF0,
+    0x1F, 0x00, 0x05, 0x00, 0x01, 0xFF, 0x89, 0x99, 0x3D, 0x1D, 0x00, 0x00,
+    0x00, 0x00, 0x49, 0x45, 0x4E, 0x44, 0xAE, 0x42, 0x60, 0x82};
+
+void writeTestPng(
+    const std::string& path,
+    const std::vector<std::pair<std::string, std::string>>& texts) {
+    auto png = freedesktop::addPngTextChunks(
+        std::string(kTestPng.begin(), kTestPng.end()), texts);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(png.data(), png.size());
+}
+
+// Test function for md5Hex
+void testMd5() {
+    // Test 1: The test suite of RFC 1321
+    assert(md5Hex("") == "d41d8cd98f00b204e9800998ecf8427e");
+    assert(md5Hex("a") == "0cc175b9c0f1b6a831c399e269772661");
+    assert(md5Hex("abc") == "900150983cd24fb0d6963f7d28e17f72");
+    assert(md5Hex("message digest") == "f96b697d7cb7938d525a2f31aaf161d0");
+    assert(md5Hex("abcdefghijklmnopqrstuvwxyz") ==
+           "c3fcd3d76192e4007dfb496cca67e13b");
+    assert(md5Hex("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+                  "0123456789") == "d174ab98d277d9f5a5611c2c9f419d9f");
+    assert(md5Hex("1234567890123456789012345678901234567890"
+                  "1234567890123456789012345678901234567890") ==
+           "57edf4a22be3c955ac49da2e2107b67a");
+}
+
+// Test function for fileToUri
+void testFileToUri() {
+    // Test 1: The characters g_filename_to_uri keeps are left as they are
+    assert(fileToUri("/photos/a-b_c.d~e!$&'()*+,:=@.png") ==
+           "file:///photos/a-b_c.d~e!$&'()*+,:=@.png");
+
+    // Test 2: The others are percent encoded byte by byte, in uppercase
+    assert(fileToUri("/photos/a b#%?.png") ==
+           "file:///photos/a%20b%23%25%3F.png");
+    assert(fileToUri("/photos/\xC3\xA9t\xC3\xA9.jpg") ==
+           "file:///photos/%C3%A9t%C3%A9.jpg");
+
+    // Test 3: Relative paths are made absolute and normalized
+    auto uri = fileToUri("folder/../image.png");
+    assert(uri.rfind("file:///", 0) == 0);
+    assert(uri.find("..") == std::string::npos);
+    assert(uri.size() > 10 && uri.substr(uri.size() - 10) == "/image.png");
+}
+
+// Test function for readPngTextChunks and loadSharedThumbnail
+void testSharedThumbnails() {
+    TestDirectory testDirectory;
+
+    // Test 1: The text chunks are read back, the other chunks are skipped
+    {
+        auto path = testDirectory.getPath("aivShared.png");
+        writeTestPng(path, {{"Thumb::URI", "file:///a.png"},
+                            {"Thumb::MTime", "1234"},
+                            {"Software", ""}});
+        auto texts = freedesktop::readPngTextChunks(path);
+        assert(texts.size() == 3);
+        assert(texts["Thumb::URI"] == "file:///a.png");
+        assert(texts["Thumb::MTime"] == "1234");
+        assert(texts["Software"] == "");
+
+        auto notPng =
+            testDirectory.writeFile("aivShared.txt", {'t', 'E', 'X', 't'});
+        assert(freedesktop::readPngTextChunks(notPng).empty());
+    }
+
+    // The thumbnails are kept in "$XDG_CACHE_HOME/thumbnails"
+    std::filesystem::path cacheDirectory = testDirectory.getPath("cache");
+    std::filesystem::create_directories(cacheDirectory / "thumbnails" /
+                                        "normal");
+    setenv("XDG_CACHE_HOME", cacheDirectory.c_str(), 1);
+
+    auto image = testDirectory.writeFile("aivSharedImage.png", {1, 2, 3});
+    struct stat imageStat;
+    assert(stat(image.c_str(), &imageStat) == 0);
+    auto uri       = fileToUri(image);
+    auto thumbnail = (cacheDirectory / "thumbnails" / "normal" /
+                      (md5Hex(uri) + ".png"))
+                         .string();
+
+    // Test 2: An up to date thumbnail is loaded with the original size
+    {
+        writeTestPng(thumbnail,
+                     {{"Thumb::URI", uri},
+                      {"Thumb::MTime", std::to_string(imageStat.st_mtime)},
+                      {"Thumb::Image::Width", "640"},
+                      {"Thumb::Image::Height", "480"}});
+        auto shared = loadSharedThumbnail(image, 128);
+        assert(shared);
+        assert(shared.value().surface);
+        assert(shared.value().originalWidth == 640);
+        assert(shared.value().originalHeight == 480);
+        // The normal flavor is too small for 256 pixels
+        assert(!loadSharedThumbnail(image, 256));
+    }
+
+    // Test 3: A thumbnail with another modification time is stale
+    {
+        writeTestPng(thumbnail,
+                     {{"Thumb::URI", uri},
+                      {"Thumb::MTime",
+                       std::to_string(imageStat.st_mtime - 1)}});
+        assert(!loadSharedThumbnail(image, 128));
+        writeTestPng(thumbnail, {{"Thumb::URI", uri}});
+        assert(!loadSharedThumbnail(image, 128));
+    }
+
+    // Test 4: So is one written for another file
+    {
+        writeTestPng(thumbnail,
+                     {{"Thumb::URI", uri + "x"},
+                      {"Thumb::MTime", std::to_string(imageStat.st_mtime)}});
+        assert(!loadSharedThumbnail(image, 128));
+    }
+}
+
+int main() {
+    testMd5();
+    testFileToUri();
+    testSharedThumbnails();
+    return 0;
+}
@@ -0,0 +1,219 @@
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "GifDecoder.hpp"
+#include "testUtils.hpp"
+
+// Header of a GIF with a global table of 4 colors: black, red, green, blue
+auto gifHeader(int width, int height) -> std::vector<Uint8> {
+    return {'G', 'I', 'F', '8', '9', 'a',
+            (Uint8)width, (Uint8)(width >> 8), (Uint8)height,
+            (Uint8)(height >> 8), 0x81, 0, 0,
+            0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255};
+}
+
+struct TestFrame {
+    int x, y, w, h;
+    // Color indices in the order they are stored
+    std::vector<Uint8> indices;
+    int disposal{0};
+    int transparentIndex{-1};
+    bool interlaced{false};
+};
+
+// Appends a frame compressed with 3 bits codes only: a clear code every 2
+// indices keeps the LZW table from growing to 4 bits
+void appendFrame(std::vector<Uint8>& gif, const TestFrame& frame) {
+    gif.insert(gif.end(), {0x21, 0xF9, 4,
+                           (Uint8)(frame.disposal << 2 |
+                                   (frame.transparentIndex >= 0 ? 1 : 0)),
+                           10, 0, (Uint8)std::max(frame.transparentIndex, 0),
+                           0});
+    gif.insert(gif.end(), {0x2C, (Uint8)frame.x, (Uint8)(frame.x >> 8),
+                           (Uint8)frame.y, (Uint8)(frame.y >> 8),
+                           (Uint8)frame.w, (Uint8)(frame.w >> 8),
+                           (Uint8)frame.h, (Uint8)(frame.h >> 8),
+                           (Uint8)(frame.interlaced ? 0x40 : 0)});
+    std::vector<int> codes;
+    for (std::size_t i = 0; i < frame.indices.size(); ++i) {
+        if (i % 2 == 0) {
+            codes.push_back(4);
+        }
+        codes.push_back(frame.indices[i]);
+    }
+    codes.push_back(5);
+    std::vector<Uint8> data;
+    int bits = 0, numBits = 0;
+    for (int code : codes) {
+        bits |= code << numBits;
+        numBits += 3;
+        while (numBits >= 8) {
+            data.push_back((Uint8)bits);
+            bits >>= 8;
+            numBits -= 8;
+        }
+    }
+    if (numBits > 0) {
+        data.push_back((Uint8)bits);
+    }
+    gif.push_back(2);
+    for (std::size_t i = 0; i < data.size(); i += 255) {
+        std::size_t size = std::min<std::size_t>(255, data.size() - i);
+        gif.push_back((Uint8)size);
+        gif.insert(gif.end(), data.begin() + i, data.begin() + i + size);
+    }
+    gif.push_back(0);
+}
+
+auto openTestGif(TestDirectory& testDirectory, const std::string& name,
+                 std::vector<Uint8> gif) -> std::optional<GifDecoder> {
+    gif.push_back(0x3B);
+    return GifDecoder::open(testDirectory.writeFile(name, gif));
+}
+
+// Red, green and blue of the global table, 0 for a transparent pixel
+auto getColor(const GifDecoder& decoder, int x, int y) -> int {
+    const Uint8* pixel =
+        decoder.getCanvas() + ((std::size_t)y * decoder.getWidth() + x) * 4;
+    if (pixel[3] == 0) {
+        return 0;
+    }
+    return pixel[0] ? 1 : pixel[1] ? 2 : pixel[2] ? 3 : 0;
+}
+
+// Test function for GifDecoder
+void testGifDecoder() {
+    TestDirectory testDirectory;
+
+    // Test 1: The rows of an interlaced frame are put back in order
+    {
+        auto gif = gifHeader(1, 8);
+        // Rows 0, 4, then 2, 6, then 1, 3, 5, 7
+        appendFrame(gif, {0, 0, 1, 8, {1, 2, 3, 1, 2, 3, 1, 2}, 0, -1, true});
+        auto decoder = openTestGif(testDirectory, "aivGif1.gif", gif);
+        assert(decoder);
+        assert(decoder->decodeNextFrame());
+        std::vector<int> expected{1, 2, 3, 1, 2, 3, 1, 2};
+        std::vector<int> stored{0, 4, 2, 6, 1, 3, 5, 7};
+        for (int row = 0; row < 8; ++row) {
+            assert(getColor(*decoder, 0, stored[row]) == expected[row]);
+        }
+        assert(!decoder->decodeNextFrame());
+        assert(decoder->getNumFrames() == 1);
+    }
+
+    // Test 2: Disposal 2 clears the area of the frame before the next one
+    {
+        auto gif = gifHeader(4, 1);
+        appendFrame(gif, {0, 0, 4, 1, {1, 1, 1, 1}});
+        appendFrame(gif, {1, 0, 2, 1, {2, 2}, 2});
+        appendFrame(gif, {3, 0, 1, 1, {3}});
+        auto decoder = openTestGif(testDirectory, "aivGif2.gif", gif);
+        assert(decoder);
+        assert(decoder->decodeNextFrame());
+        assert(decoder->decodeNextFrame());
+        assert(getColor(*decoder, 1, 0) == 2);
+        decoder->takeDirtyRect();
+        assert(decoder->decodeNextFrame());
+        assert(getColor(*decoder, 0, 0) == 1);
+        assert(getColor(*decoder, 1, 0) == 0);
+        assert(getColor(*decoder, 2, 0) == 0);
+        assert(getColor(*decoder, 3, 0) == 3);
+        SDL_Rect dirtyRect = decoder->takeDirtyRect();
+        assert(dirtyRect.x == 1 && dirtyRect.w == 3);
+    }
+
+    // Test 3: Disposal 3 restores what was under the frame
+    {
+        auto gif = gifHeader(4, 1);
+        appendFrame(gif, {0, 0, 4, 1, {1, 1, 1, 1}});
+        appendFrame(gif, {1, 0, 2, 1, {2, 2}, 3});
+        appendFrame(gif, {3, 0, 1, 1, {3}});
+        auto decoder = openTestGif(testDirectory, "aivGif3.gif", gif);
+        assert(decoder);
+        assert(decoder->decodeNextFrame());
+        assert(decoder->decodeNextFrame());
+        assert(decoder->decodeNextFrame());
+        std::vector<int> expected{1, 1, 1, 3};
+        for (int x = 0; x < 4; ++x) {
+            assert(getColor(*decoder, x, 0) == expected[x]);
+        }
+    }
+
+    // Test 4: The transparent pixels leave the previous frame visible
+    {
+        auto gif = gifHeader(4, 1);
+        appendFrame(gif, {0, 0, 4, 1, {1, 1, 1, 1}});
+        appendFrame(gif, {0, 0, 4, 1, {2, 0, 0, 3}, 0, 0});
+        auto decoder = openTestGif(testDirectory, "aivGif4.gif", gif);
+        assert(decoder);
+        assert(decoder->decodeNextFrame());
+        assert(decoder->decodeNextFrame());
+        std::vector<int> expected{2, 1, 1, 3};
+        for (int x = 0; x < 4; ++x) {
+            assert(getColor(*decoder, x, 0) == expected[x]);
+        }
+    }
+
+    // Test 5: Seeking backward past a checkpoint composes the same canvas
+    // as decoding from the start
+    {
+        constexpr int kNumFrames = 40;
+        auto gif                 = gifHeader(8, 1);
+        appendFrame(gif, {0, 0, 8, 1, {0, 0, 0, 0, 0, 0, 0, 0}});
+        for (int i = 1; i < kNumFrames; ++i) {
+            appendFrame(gif, {i % 8, 0, 1, 1, {(Uint8)(1 + i % 3)},
+                              i % 5 == 0 ? 3 : i % 7 == 0 ? 2 : 0});
+        }
+        auto decoder = openTestGif(testDirectory, "aivGif5.gif", gif);
+        assert(decoder);
+        std::vector<std::vector<Uint8>> canvases;
+        while (decoder->decodeNextFrame()) {
+            canvases.emplace_back(decoder->getCanvas(),
+                                  decoder->getCanvas() + 8 * 4);
+        }
+        assert(decoder->getNumFrames() == kNumFrames);
+        for (int index : {35, 20, 17, 16, 15, 3, 0, 39}) {
+            assert(decoder->seekToFrame(index));
+            assert(decoder->getFrameIndex() == index);
+            assert(std::equal(canvases[index].begin(), canvases[index].end(),
+                              decoder->getCanvas()));
+            SDL_Rect dirtyRect = decoder->takeDirtyRect();
+            assert(dirtyRect.w == 8 && dirtyRect.h == 1);
+        }
+        assert(!decoder->seekToFrame(kNumFrames));
+    }
+
+    // Test 6: A frame larger than the logical screen is corrupt, one going
+    // past its edges is clamped
+    {
+        auto gif = gifHeader(4, 1);
+        appendFrame(gif, {2, 0, 4, 1, {1, 2, 3, 1}});
+        std::vector<Uint8> oversize{0x2C, 0, 0, 0, 0, 0xFF, 0xFF, 0xFF, 0xFF,
+                                    0, 2, 0};
+        gif.insert(gif.end(), oversize.begin(), oversize.end());
+        auto decoder = openTestGif(testDirectory, "aivGif6.gif", gif);
+        assert(decoder);
+        assert(decoder->decodeNextFrame());
+        std::vector<int> expected{0, 0, 1, 2};
+        for (int x = 0; x < 4; ++x) {
+            assert(getColor(*decoder, x, 0) == expected[x]);
+        }
+        assert(!decoder->decodeNextFrame());
+        assert(decoder->getNumFrames() == 1);
+    }
+
+    // Test 7: So is a logical screen too large to be allocated
+    {
+        auto gif = gifHeader(0xFFFF, 0xFFFF);
+        assert(!openTestGif(testDirectory, "aivGif7.gif", gif));
+    }
+}
+
+int main() {
+    testGifDecoder();
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <cassert>
+#include <vector>
+
+#include "ImageCache.hpp"
+
+// Test function for ImageCache
+void testImageCache() {
+    const auto isNotProtected = [](std::size_t) { return false; };
+
+    // Test 1: The least recently used images are evicted first, until the
+    // rest fit in the budget
+    {
+        ImageCache cache(300);
+        cache.touch(0, 100);
+        cache.touch(1, 100);
+        cache.touch(2, 100);
+        assert(cache.totalBytes() == 300);
+        assert(cache.evict(isNotProtected).empty());
+
+        cache.touch(3, 150);
+        auto evicted = cache.evict(isNotProtected);
+        assert((evicted == std::vector<std::size_t>{0, 1}));
+        assert(!cache.contains(0) && !cache.contains(1));
+        assert(cache.contains(2) && cache.contains(3));
+        assert(cache.totalBytes() == 250);
+    }
+
+    // Test 2: Touching an image again makes it the most recently used one
+    // and replaces its size
+    {
+        ImageCache cache(300);
+        cache.touch(0, 100);
+        cache.touch(1, 100);
+        cache.touch(2, 100);
+        cache.touch(0, 120);
+        assert(cache.totalBytes() == 320);
+        auto evicted = cache.evict(isNotProtected);
+        assert((evicted == std::vector<std::size_t>{1}));
+        assert(cache.contains(0));
+    }
+
+    // Test 3: The protected images are skipped, even over the budget
+    {
+        ImageCache cache(100);
+        cache.touch(0, 100);
+        cache.touch(1, 100);
+        cache.touch(2, 100);
+        auto evicted =
+            cache.evict([](std::size_t index) { return index != 1; });
+        assert((evicted == std::vector<std::size_t>{1}));
+        assert(cache.totalBytes() == 200);
+        assert(cache.evict([](std::size_t) { return true; }).empty());
+        assert(cache.totalBytes() == 200);
+    }
+
+    // Test 4: Erased images are no longer accounted, and a lower budget
+    // applies to the next evict
+    {
+        ImageCache cache(1000);
+        cache.touch(0, 100);
+        cache.touch(1, 200);
+        cache.erase(0);
+        cache.erase(5);
+        assert(!cache.contains(0));
+        assert(cache.totalBytes() == 200);
+
+        cache.touch(2, 300);
+        cache.setBudget(300);
+        assert(cache.totalBytes() == 500);
+        auto evicted = cache.evict(isNotProtected);
+        assert((evicted == std::vector<std::size_t>{1}));
+        assert(cache.totalBytes() == 300);
+    }
+}
+
+int main() {
+    testImageCache();
+    return 0;
+}
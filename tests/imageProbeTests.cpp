@@ -0,0 +1,130 @@
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "imageProbe.hpp"
+#include "testUtils.hpp"
+
+// Test function for probeImage
+void testProbeImage() {
+    TestDirectory testDirectory;
+
+    // Test 1: PNG, the dimensions come from the IHDR chunk
+    {
+        auto probe = probeImage("../image0.png");
+        assert(probe);
+        assert(probe.value().width == 1920);
+        assert(probe.value().height == 1080);
+        assert(probe.value().numFrames == 1);
+    }
+
+    // Test 2: JPEG with an EXIF orientation before the frame header
+    {
+        std::vector<Uint8> jpeg{
+            0xFF, 0xD8,
+            // APP1, little endian TIFF with one entry: orientation 3
+            0xFF, 0xE1, 0x00, 0x22, 'E', 'x', 'i', 'f', 0, 0,
+            'I', 'I', 0x2A, 0x00, 0x08, 0x00, 0x00, 0x00,
+            0x01, 0x00,
+            0x12, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00,
+            // SOF0, 8 bits, 32x64
+            0xFF, 0xC0, 0x00, 0x11, 0x08, 0x00, 0x20, 0x00, 0x40, 0x03,
+            0x01, 0x22, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11, 0x01};
+        auto probe = probeImage(testDirectory.writeFile("aivProbe.jpg", jpeg));
+        assert(probe);
+        assert(probe.value().width == 64);
+        assert(probe.value().height == 32);
+        assert(probe.value().orientation == 3);
+    }
+
+    // Test 3: GIF with two frames, the first one with a control extension
+    {
+        std::vector<Uint8> gif{
+            'G', 'I', 'F', '8', '9', 'a', 0x03, 0x00, 0x02, 0x00, 0x80, 0x00,
+            0x00,
+            // Global color table with 2 colors
+            0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF,
+            0x21, 0xF9, 0x04, 0x00, 0x0A, 0x00, 0x00, 0x00,
+            0x2C, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x02, 0x00, 0x00,
+            0x02, 0x02, 0x44, 0x01, 0x00,
+            0x2C, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x02, 0x00, 0x00,
+            0x02, 0x02, 0x44, 0x01, 0x00,
+            0x3B};
+        auto probe = probeImage(testDirectory.writeFile("aivProbe.gif", gif));
+        assert(probe);
+        assert(probe.value().width == 3);
+        assert(probe.value().height == 2);
+        assert(probe.value().numFrames == 2);
+    }
+
+    // Test 4: Top-down BMP, with a negative height
+    {
+        std::vector<Uint8> bmp{'B',  'M',  0x00, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x36, 0x00, 0x00, 0x00,
+                               0x28, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00,
+                               0x00, 0xF9, 0xFF, 0xFF, 0xFF};
+        auto probe = probeImage(testDirectory.writeFile("aivProbe.bmp", bmp));
+        assert(probe);
+        assert(probe.value().width == 5);
+        assert(probe.value().height == 7);
+    }
+
+    // Test 5: Big endian TIFF with two pages
+    {
+        std::vector<Uint8> tiff{
+            'M', 'M', 0x00, 0x2A, 0x00, 0x00, 0x00, 0x08,
+            0x00, 0x03,
+            0x01, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x01, 0x00, 0x10, 0x00, 0x00,
+            0x01, 0x01, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x09,
+            0x01, 0x12, 0x00, 0x03, 0x00, 0x00, 0x00, 0x01, 0x00, 0x06, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x32,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+        auto probe = probeImage(testDirectory.writeFile("aivProbe.tiff", tiff));
+        assert(probe);
+        assert(probe.value().width == 16);
+        assert(probe.value().height == 9);
+        assert(probe.value().orientation == 6);
+        assert(probe.value().numFrames == 2);
+    }
+
+    // Test 6: Animated PNG with a 1 byte sRGB chunk and a gAMA chunk before
+    // the acTL chunk
+    {
+        std::vector<Uint8> png{
+            0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n',
+            // IHDR, 16x8 RGBA
+            0x00, 0x00, 0x00, 0x0D, 'I', 'H', 'D', 'R',
+            0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x08,
+            0x08, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            // sRGB, perceptual
+            0x00, 0x00, 0x00, 0x01, 's', 'R', 'G', 'B', 0x00,
+            0x00, 0x00, 0x00, 0x00,
+            // gAMA
+            0x00, 0x00, 0x00, 0x04, 'g', 'A', 'M', 'A',
+            0x00, 0x00, 0xB1, 0x8F, 0x00, 0x00, 0x00, 0x00,
+            // acTL, 3 frames played forever
+            0x00, 0x00, 0x00, 0x08, 'a', 'c', 'T', 'L',
+            0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00};
+        auto probe = probeImage(testDirectory.writeFile("aivProbe.png", png));
+        assert(probe);
+        assert(probe.value().width == 16);
+        assert(probe.value().height == 8);
+        assert(probe.value().numFrames == 3);
+    }
+
+    // Test 7: Empty and unknown files
+    {
+        assert(!probeImage("../tests/testDir/test.png"));
+        assert(!probeImage(testDirectory.writeFile(
+            "aivProbe.txt", {'t', 'e', 'x', 't', ' ', 'f', 'i', 'l', 'e'})));
+    }
+}
+
+int main() {
+    testProbeImage();
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "sdlUtils.hpp"
+
+// Compares the time to create a thumbnail of a big JPEG through the full
+// size texture (IMG_LoadTexture + render to target), a full decode
+// downscaled in the CPU, and the libjpeg DCT scaled decode.
+
+void writeTestJpeg(const std::string& filename, int width, int height) {
+    FILE* file = std::fopen(filename.c_str(), "wb");
+    assert(file != nullptr);
+
+    jpeg_compress_struct compress;
+    jpeg_error_mgr error;
+    compress.err = jpeg_std_error(&error);
+    jpeg_create_compress(&compress);
+    jpeg_stdio_dest(&compress, file);
+    compress.image_width      = width;
+    compress.image_height     = height;
+    compress.input_components = 3;
+    compress.in_color_space   = JCS_RGB;
+    jpeg_set_defaults(&compress);
+    jpeg_set_quality(&compress, 90, TRUE);
+    jpeg_start_compress(&compress, TRUE);
+
+    std::vector<Uint8> row(width * 3);
+    while (compress.next_scanline < compress.image_height) {
+        int y = (int)compress.next_scanline;
+        for (int x = 0; x < width; ++x) {
+            row[x * 3]     = (Uint8)(x * 255 / width);
+            row[x * 3 + 1] = (Uint8)(y * 255 / height);
+            row[x * 3 + 2] = (Uint8)((x ^ y) & 0xff);
+        }
+        JSAMPROW rowPointer = row.data();
+        jpeg_write_scanlines(&compress, &rowPointer, 1);
+    }
+    jpeg_finish_compress(&compress);
+    jpeg_destroy_compress(&compress);
+    std::fclose(file);
+}
+
+auto measureMilliseconds(int iterations, const std::function<void()>& f)
+    -> double {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        f();
+    }
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+int main() {
+    constexpr int kIterations    = 5;
+    constexpr int kThumbnailSize = 100;
+    const std::string filename{"jpegThumbnailBenchmark.jpg"};
+
+    IMG_Init(IMG_INIT_JPG);
+    writeTestJpeg(filename, 6000, 4000);
+
+    // Software renderer, as in the machines without GPU
+    SdlSurface target =
+        createSurface(SDL_CreateRGBSurfaceWithFormat(0, 64, 64, 32,
+                                                     SDL_PIXELFORMAT_RGBA32));
+    SdlRenderer renderer(SDL_CreateSoftwareRenderer(target.get()),
+                         &SDL_DestroyRenderer);
+    assert(renderer);
+
+    double texturePath = measureMilliseconds(kIterations, [&]() {
+        auto texture = createTexture(renderer, filename);
+        assert(texture);
+        createThumbnail(renderer, texture.value(), kThumbnailSize,
+                        kThumbnailSize);
+    });
+
+    double cpuPath = measureMilliseconds(kIterations, [&]() {
+        int width, height;
+        long memory;
+        auto thumbnail = loadThumbnailSurface(filename, kThumbnailSize,
+                                              kThumbnailSize, width, height,
+                                              memory);
+        assert(thumbnail);
+    });
+
+    double scaledPath = measureMilliseconds(kIterations, [&]() {
+        int width, height;
+        long memory;
+        auto thumbnail = createThumbnailWithSize(
+            renderer, filename, kThumbnailSize, kThumbnailSize, width, height,
+            memory);
+        assert(thumbnail && width == 6000 && height == 4000);
+    });
+
+    std::cout << "6000x4000 JPEG to " << kThumbnailSize
+              << "px thumbnail, ms per image:\n"
+              << "  IMG_LoadTexture + render target: " << texturePath << "\n"
+              << "  IMG_Load + CPU downscale:        " << cpuPath << "\n"
+              << "  libjpeg DCT scaled decode:       " << scaledPath << "\n";
+
+    std::remove(filename.c_str());
+    return 0;
+}
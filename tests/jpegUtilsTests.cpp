@@ -0,0 +1,186 @@
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "jpegUtils.hpp"
+#include "testUtils.hpp"
+
+// Smallest JPEG stream the parsers accept as a thumbnail
+const std::vector<Uint8> kThumbnail{0xFF, 0xD8, 0xFF, 0xD9};
+
+// TIFF header, an empty IFD0 and an IFD1 pointing to the thumbnail stored
+// right after it
+auto createExifTiff(bool littleEndian, const std::vector<Uint8>& thumbnail)
+    -> std::vector<Uint8> {
+    std::vector<Uint8> tiff;
+    const auto write16 = [&](uint32_t value) {
+        if (littleEndian) {
+            tiff.insert(tiff.end(), {(Uint8)value, (Uint8)(value >> 8)});
+        } else {
+            tiff.insert(tiff.end(), {(Uint8)(value >> 8), (Uint8)value});
+        }
+    };
+    const auto write32 = [&](uint32_t value) {
+        if (littleEndian) {
+            write16(value & 0xFFFF);
+            write16(value >> 16);
+        } else {
+            write16(value >> 16);
+            write16(value & 0xFFFF);
+        }
+    };
+    const char* byteOrder = littleEndian ? "II" : "MM";
+    tiff.insert(tiff.end(), byteOrder, byteOrder + 2);
+    write16(0x2A);
+    write32(8);
+    // IFD0, no entries, then the offset of IFD1
+    write16(0);
+    write32(14);
+    // IFD1 with JPEGInterchangeFormat and JPEGInterchangeFormatLength
+    write16(2);
+    write16(0x0201);
+    write16(4);
+    write32(1);
+    write32(44);
+    write16(0x0202);
+    write16(4);
+    write32(1);
+    write32((uint32_t)thumbnail.size());
+    write32(0);
+    tiff.insert(tiff.end(), thumbnail.begin(), thumbnail.end());
+    return tiff;
+}
+
+auto createSegment(Uint8 marker, const std::vector<Uint8>& payload)
+    -> std::vector<Uint8> {
+    std::size_t length = payload.size() + 2;
+    std::vector<Uint8> segment{0xFF, marker, (Uint8)(length >> 8),
+                               (Uint8)length};
+    segment.insert(segment.end(), payload.begin(), payload.end());
+    return segment;
+}
+
+auto createExifSegment(const std::vector<Uint8>& tiff) -> std::vector<Uint8> {
+    std::vector<Uint8> payload{'E', 'x', 'i', 'f', 0, 0};
+    payload.insert(payload.end(), tiff.begin(), tiff.end());
+    return createSegment(0xE1, payload);
+}
+
+auto createJfxxSegment(const std::vector<Uint8>& thumbnail)
+    -> std::vector<Uint8> {
+    std::vector<Uint8> payload{'J', 'F', 'X', 'X', 0, 0x10};
+    payload.insert(payload.end(), thumbnail.begin(), thumbnail.end());
+    return createSegment(0xE0, payload);
+}
+
+// SOI, the segments, then a SOF0 of 32x64
+auto createJpeg(const std::vector<std::vector<Uint8>>& segments)
+    -> std::vector<Uint8> {
+    std::vector<Uint8> jpeg{0xFF, 0xD8};
+    for (const auto& segment : segments) {
+        jpeg.insert(jpeg.end(), segment.begin(), segment.end());
+    }
+    auto frame = createSegment(0xC0, {0x08, 0x00, 0x40, 0x00, 0x20, 0x01,
+                                      0x01, 0x11, 0x00});
+    jpeg.insert(jpeg.end(), frame.begin(), frame.end());
+    return jpeg;
+}
+
+// Test function for readExifThumbnail
+void testReadExifThumbnail() {
+    // Test 1: The thumbnail of IFD1, in both byte orders
+    assert(readExifThumbnail(createExifTiff(true, kThumbnail)) == kThumbnail);
+    assert(readExifThumbnail(createExifTiff(false, kThumbnail)) == kThumbnail);
+
+    // Test 2: A thumbnail that is not a JPEG stream is ignored
+    assert(readExifThumbnail(createExifTiff(true, {0, 1, 2, 3})).empty());
+
+    // Test 3: So are the offsets past the end of a truncated block
+    auto tiff = createExifTiff(true, kThumbnail);
+    for (std::size_t size : {tiff.size() - 1, (std::size_t)30,
+                             (std::size_t)12, (std::size_t)4}) {
+        std::vector<Uint8> truncated(tiff.begin(), tiff.begin() + size);
+        assert(readExifThumbnail(truncated).empty());
+    }
+}
+
+// Test function for readJpegHeader
+void testReadJpegHeader() {
+    TestDirectory testDirectory;
+
+    // Test 1: The size comes from the frame header, the thumbnail from the
+    // EXIF block
+    {
+        auto path = testDirectory.writeFile(
+            "aivJpeg1.jpg",
+            createJpeg({createExifSegment(createExifTiff(false, kThumbnail))}));
+        auto header = readJpegHeader(path);
+        assert(header);
+        assert(header.value().width == 32);
+        assert(header.value().height == 64);
+        assert(header.value().embeddedThumbnail == kThumbnail);
+    }
+
+    // Test 2: Or from the JFIF extension
+    {
+        auto jfif = createSegment(0xE0, {'J', 'F', 'I', 'F', 0});
+        auto path = testDirectory.writeFile(
+            "aivJpeg2.jpg", createJpeg({jfif, createJfxxSegment(kThumbnail)}));
+        auto header = readJpegHeader(path);
+        assert(header);
+        assert(header.value().embeddedThumbnail == kThumbnail);
+    }
+
+    // Test 3: The first thumbnail found is kept
+    {
+        std::vector<Uint8> jfxxThumbnail{0xFF, 0xD8, 0x00, 0xFF, 0xD9};
+        auto path = testDirectory.writeFile(
+            "aivJpeg3.jpg",
+            createJpeg({createExifSegment(createExifTiff(true, kThumbnail)),
+                        createJfxxSegment(jfxxThumbnail)}));
+        auto header = readJpegHeader(path);
+        assert(header);
+        assert(header.value().embeddedThumbnail == kThumbnail);
+    }
+
+    // Test 4: A truncated EXIF block has no thumbnail, but the frame header
+    // after it is still read
+    {
+        auto tiff = createExifTiff(true, kThumbnail);
+        tiff.resize(20);
+        auto path = testDirectory.writeFile(
+            "aivJpeg4.jpg", createJpeg({createExifSegment(tiff)}));
+        auto header = readJpegHeader(path);
+        assert(header);
+        assert(header.value().width == 32);
+        assert(header.value().embeddedThumbnail.empty());
+    }
+
+    // Test 5: An APP1 segment longer than the file is corrupt
+    {
+        auto jpeg = createJpeg(
+            {createExifSegment(createExifTiff(true, kThumbnail))});
+        jpeg.resize(30);
+        auto path = testDirectory.writeFile("aivJpeg5.jpg", jpeg);
+        assert(!readJpegHeader(path));
+    }
+
+    // Test 6: As is a file without a frame header, or that is not a JPEG
+    {
+        std::vector<Uint8> jpeg{0xFF, 0xD8};
+        auto exif = createExifSegment(createExifTiff(true, kThumbnail));
+        jpeg.insert(jpeg.end(), exif.begin(), exif.end());
+        jpeg.insert(jpeg.end(), {0xFF, 0xD9});
+        assert(!readJpegHeader(testDirectory.writeFile("aivJpeg6.jpg", jpeg)));
+        assert(!readJpegHeader(
+            testDirectory.writeFile("aivJpeg7.jpg", {0x89, 'P'})));
+    }
+}
+
+int main() {
+    testReadExifThumbnail();
+    testReadJpegHeader();
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <cassert>
+
+#include "MemoryAccounting.hpp"
+
+// Test function for MemoryAccounting
+void testMemoryAccounting() {
+    // Test 1: Setting an owner again replaces its bytes
+    {
+        MemoryAccounting accounting(1000);
+        accounting.set(MemoryCategory::Images, 3, 100);
+        accounting.set(MemoryCategory::Images, 4, 50);
+        assert(accounting.getBytes(MemoryCategory::Images) == 150);
+        accounting.set(MemoryCategory::Images, 3, 20);
+        assert(accounting.getBytes(MemoryCategory::Images) == 70);
+        assert(accounting.totalBytes() == 70);
+    }
+
+    // Test 2: The categories are accounted apart, even with the same owner
+    {
+        MemoryAccounting accounting(1000);
+        accounting.set(MemoryCategory::Thumbnails, 0, 300);
+        accounting.set(MemoryCategory::Images, 0, 200);
+        accounting.set(MemoryCategory::Animations, 0, 100);
+        assert(accounting.getBytes(MemoryCategory::Thumbnails) == 300);
+        assert(accounting.getBytes(MemoryCategory::Images) == 200);
+        assert(accounting.getBytes(MemoryCategory::Animations) == 100);
+        assert(accounting.totalBytes() == 600);
+
+        accounting.erase(MemoryCategory::Images, 0);
+        assert(accounting.getBytes(MemoryCategory::Images) == 0);
+        assert(accounting.getBytes(MemoryCategory::Thumbnails) == 300);
+        assert(accounting.totalBytes() == 400);
+    }
+
+    // Test 3: Erasing an owner that was never set changes nothing
+    {
+        MemoryAccounting accounting(1000);
+        accounting.set(MemoryCategory::Animations, 1, 10);
+        accounting.erase(MemoryCategory::Animations, 2);
+        accounting.erase(MemoryCategory::Images, 1);
+        assert(accounting.totalBytes() == 10);
+    }
+
+    // Test 4: The excess is what is over the budget, never negative
+    {
+        MemoryAccounting accounting(1000);
+        assert(accounting.getBudget() == 1000);
+        assert(accounting.excessBytes() == 0);
+        accounting.set(MemoryCategory::Thumbnails, 0, 800);
+        assert(accounting.excessBytes() == 0);
+        accounting.set(MemoryCategory::Images, 5, 300);
+        assert(accounting.excessBytes() == 100);
+        accounting.set(MemoryCategory::Thumbnails, 0, 700);
+        assert(accounting.excessBytes() == 0);
+    }
+}
+
+int main() {
+    testMemoryAccounting();
+    return 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "SDL.h"
+
+// Directory for the files written by a test, removed with it. Its name
+// holds the process id, so the tests can run in parallel.
+class TestDirectory {
+  public:
+    TestDirectory();
+    ~TestDirectory();
+
+    TestDirectory(const TestDirectory&)                    = delete;
+    auto operator=(const TestDirectory&) -> TestDirectory& = delete;
+
+    auto getPath(const std::string& name) const -> std::string;
+    // Returns the path of the file
+    auto writeFile(const std::string& name, const std::vector<Uint8>& bytes)
+        -> std::string;
+
+  private:
+    std::filesystem::path directory;
+};
+
+//**************************************************************
+//********************* Implementation *************************
+//**************************************************************
+
+TestDirectory::TestDirectory() {
+    static int numDirectories = 0;
+    directory = std::filesystem::temp_directory_path() /
+                ("aivTests-" + std::to_string(getpid()) + "-" +
+                 std::to_string(numDirectories++));
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+}
+
+TestDirectory::~TestDirectory() {
+    std::error_code error;
+    std::filesystem::remove_all(directory, error);
+}
+
+auto TestDirectory::getPath(const std::string& name) const -> std::string {
+    return (directory / name).string();
+}
+
+auto TestDirectory::writeFile(const std::string& name,
+                              const std::vector<Uint8>& bytes)
+    -> std::string {
+    auto path = getPath(name);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write((const char*)bytes.data(), bytes.size());
+    return path;
+}
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+#include "thumbnailScheduling.hpp"
+
+auto getPosition(const std::vector<std::size_t>& indices, std::size_t index)
+    -> int {
+    return (int)(std::find(indices.begin(), indices.end(), index) -
+                 indices.begin());
+}
+
+// Rows 2 to 9 of a grid of 4 columns
+auto getRowsIndices() -> std::vector<std::size_t> {
+    std::vector<std::size_t> indices;
+    for (std::size_t index = 8; index < 40; ++index) {
+        indices.push_back(index);
+    }
+    return indices;
+}
+
+// Test function for sortThumbnailsToLoad
+void testSortThumbnailsToLoad() {
+    // Rows 5 and 6 are visible
+    GridImagesState gridImagesState{4, 2, 5};
+
+    // Test 1: The visible rows from the cursor outwards, then the rows ahead
+    // of them and behind them by their distance, the ones behind counting
+    // twice
+    {
+        auto indices = getRowsIndices();
+        std::reverse(indices.begin(), indices.end());
+        sortThumbnailsToLoad(indices, gridImagesState, 1, 22);
+        assert(indices[0] == 22);
+        for (int i = 0; i < 8; ++i) {
+            assert(indices[i] >= 20 && indices[i] < 28);
+        }
+        for (int i = 1; i < 8; ++i) {
+            assert(std::abs((int)indices[i - 1] - 22) <=
+                   std::abs((int)indices[i] - 22));
+        }
+        for (int i = 8; i < 12; ++i) {
+            assert(indices[i] >= 28 && indices[i] < 32);
+        }
+        std::vector<std::size_t> expected{19, 18, 17, 16, 32, 33, 34,
+                                          35, 36, 37, 38, 39, 15, 14,
+                                          13, 12, 11, 10, 9,  8};
+        assert(std::equal(expected.begin(), expected.end(),
+                          indices.begin() + 12));
+    }
+
+    // Test 2: Scrolling up, the rows above are the ones ahead
+    {
+        auto indices = getRowsIndices();
+        sortThumbnailsToLoad(indices, gridImagesState, -1, 22);
+        for (std::size_t index = 16; index < 20; ++index) {
+            assert(getPosition(indices, index) >= 8);
+            assert(getPosition(indices, index) < 12);
+        }
+        for (std::size_t index = 8; index < 12; ++index) {
+            assert(getPosition(indices, index) < getPosition(indices, 32));
+        }
+    }
+}
+
+// Test function for takeFromFlight
+void testTakeFromFlight() {
+    auto first  = std::make_shared<std::atomic<bool>>(false);
+    auto second = std::make_shared<std::atomic<bool>>(false);
+
+    // Test 1: The result of the job in flight takes it out
+    {
+        ThumbnailsInFlight inFlight{{3, first}};
+        assert(takeFromFlight(inFlight, 3, first));
+        assert(inFlight.empty());
+    }
+
+    // Test 2: The result of a cancelled job is ignored once the image was
+    // submitted again, and the new job stays in flight until its own result
+    {
+        first->store(true);
+        ThumbnailsInFlight inFlight{{4, second}};
+        assert(!takeFromFlight(inFlight, 4, first));
+        assert(inFlight.at(4) == second);
+        assert(takeFromFlight(inFlight, 4, second));
+        assert(inFlight.empty());
+    }
+
+    // Test 3: The result of a cancelled job that was not submitted again is
+    // kept, as it may still be used
+    {
+        ThumbnailsInFlight inFlight{{6, second}};
+        assert(takeFromFlight(inFlight, 5, first));
+        assert(inFlight.size() == 1);
+    }
+}
+
+int main() {
+    testSortThumbnailsToLoad();
+    testTakeFromFlight();
+    return 0;
+}
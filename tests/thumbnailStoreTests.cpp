@@ -0,0 +1,159 @@
+#include <cassert>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "ThumbnailStore.hpp"
+#include "testUtils.hpp"
+
+auto createTestThumbnail(int width, int height, Uint8 seed) -> SdlSurface {
+    auto surface = createSurface(SDL_CreateRGBSurfaceWithFormat(
+        0, width, height, 32, SDL_PIXELFORMAT_RGBA32));
+    for (int y = 0; y < height; ++y) {
+        auto* row = (Uint8*)surface->pixels + (std::size_t)y * surface->pitch;
+        for (int x = 0; x < width * 4; ++x) {
+            row[x] = (Uint8)(seed + y * width * 4 + x);
+        }
+    }
+    return surface;
+}
+
+auto hasPixels(const SDL_Surface* surface, int width, int height, Uint8 seed)
+    -> bool {
+    if (surface->w != width || surface->h != height) {
+        return false;
+    }
+    for (int y = 0; y < height; ++y) {
+        auto* row =
+            (const Uint8*)surface->pixels + (std::size_t)y * surface->pitch;
+        for (int x = 0; x < width * 4; ++x) {
+            if (row[x] != (Uint8)(seed + y * width * 4 + x)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Test function for ThumbnailStore
+void testThumbnailStore() {
+    // The store is kept in "$XDG_CACHE_HOME/aiv/thumbnails.db"
+    TestDirectory testDirectory;
+    std::filesystem::path cacheDirectory = testDirectory.getPath("cache");
+    std::filesystem::create_directories(cacheDirectory);
+    setenv("XDG_CACHE_HOME", cacheDirectory.c_str(), 1);
+    auto database = cacheDirectory / "aiv" / "thumbnails.db";
+    constexpr long kMaxBytes = 16 * 1024 * 1024;
+
+    auto image = testDirectory.writeFile("aivStore0.png", {1, 2, 3});
+
+    // Test 1: The thumbnails are read back from the file by the next store
+    {
+        {
+            ThumbnailStore store(kMaxBytes);
+            assert(!store.find(image, 64));
+            auto thumbnail = createTestThumbnail(5, 3, 7);
+            store.insert(image, 64, thumbnail.get(), 500, 300);
+            auto found = store.find(image, 64);
+            assert(found);
+            assert(hasPixels(found.value().surface.get(), 5, 3, 7));
+        }
+        ThumbnailStore store(kMaxBytes);
+        auto found = store.find(image, 64);
+        assert(found);
+        assert(found.value().originalWidth == 500);
+        assert(found.value().originalHeight == 300);
+        assert(hasPixels(found.value().surface.get(), 5, 3, 7));
+        // The size is part of the key
+        assert(!store.find(image, 128));
+    }
+
+    // Test 2: A valid thumbnail inserted again is not written twice
+    {
+        auto fileSize = std::filesystem::file_size(database);
+        {
+            ThumbnailStore store(kMaxBytes);
+            auto thumbnail = createTestThumbnail(5, 3, 7);
+            store.insert(image, 64, thumbnail.get(), 500, 300);
+            assert(store.getPendingBytes() == 0);
+        }
+        assert(std::filesystem::file_size(database) == fileSize);
+    }
+
+    // Test 3: Changing the size or the modification time of the image
+    // invalidates its thumbnail
+    {
+        auto modificationTime = std::filesystem::last_write_time(image);
+        testDirectory.writeFile("aivStore0.png", {1, 2, 3, 4});
+        std::filesystem::last_write_time(image, modificationTime);
+        {
+            ThumbnailStore store(kMaxBytes);
+            assert(!store.find(image, 64));
+            auto thumbnail = createTestThumbnail(5, 3, 9);
+            store.insert(image, 64, thumbnail.get(), 500, 300);
+        }
+        {
+            ThumbnailStore store(kMaxBytes);
+            auto found = store.find(image, 64);
+            assert(found);
+            assert(hasPixels(found.value().surface.get(), 5, 3, 9));
+        }
+        std::filesystem::last_write_time(
+            image, modificationTime + std::chrono::seconds(10));
+        ThumbnailStore store(kMaxBytes);
+        assert(!store.find(image, 64));
+    }
+
+    // Test 4: The pending thumbnails are written once they take a few MB,
+    // and are still found after that
+    {
+        std::filesystem::remove(database);
+        std::vector<std::string> images;
+        for (int i = 0; i < 8; ++i) {
+            images.push_back(testDirectory.writeFile(
+                "aivStore" + std::to_string(i) + ".png", {(Uint8)i}));
+        }
+        ThumbnailStore store(kMaxBytes);
+        for (int i = 0; i < 8; ++i) {
+            auto thumbnail = createTestThumbnail(512, 512, (Uint8)i);
+            store.insert(images[i], 512, thumbnail.get(), 4000, 3000);
+            assert(store.getPendingBytes() < 4 * 1024 * 1024);
+        }
+        assert(std::filesystem::file_size(database) >= 4 * 512 * 512 * 4);
+        for (int i = 0; i < 8; ++i) {
+            auto found = store.find(images[i], 512);
+            assert(found);
+            assert(hasPixels(found.value().surface.get(), 512, 512, (Uint8)i));
+        }
+    }
+
+    // Test 5: Over the limit, the file is compacted under it keeping the
+    // newest thumbnails
+    {
+        std::filesystem::remove(database);
+        std::vector<std::string> images;
+        for (int i = 0; i < 5; ++i) {
+            images.push_back(testDirectory.writeFile(
+                "aivStore" + std::to_string(i) + ".png", {(Uint8)i}));
+        }
+        // Room for 4 thumbnails of 1 MB, the fifth one compacts the file
+        constexpr long kSmallMaxBytes = 4 * 1024 * 1024 + 64 * 1024;
+        for (int i = 0; i < 5; ++i) {
+            ThumbnailStore store(kSmallMaxBytes);
+            auto thumbnail = createTestThumbnail(512, 512, (Uint8)i);
+            store.insert(images[i], 512, thumbnail.get(), 4000, 3000);
+        }
+        assert(std::filesystem::file_size(database) <= 0.75 * kSmallMaxBytes);
+        ThumbnailStore store(kSmallMaxBytes);
+        assert(store.find(images[4], 512));
+        assert(store.find(images[2], 512));
+        assert(!store.find(images[0], 512));
+    }
+}
+
+int main() {
+    testThumbnailStore();
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "WorkerPool.hpp"
+
+// Drains the queue until it gave the expected number of values
+auto drainAll(ResultQueue<int>& results, std::size_t numValues)
+    -> std::vector<int> {
+    std::vector<int> values;
+    while (values.size() < numValues) {
+        for (int value : results.drain()) {
+            values.push_back(value);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return values;
+}
+
+// Test function for WorkerPool and ResultQueue
+void testWorkerPool() {
+    // Test 1: Every submitted job runs once and posts its result
+    {
+        WorkerPool pool(3);
+        assert(pool.numThreads() == 3);
+        ResultQueue<int> results;
+        for (int i = 0; i < 100; ++i) {
+            pool.submit([&results, i]() { results.push(int(i)); });
+        }
+        auto values = drainAll(results, 100);
+        std::sort(values.begin(), values.end());
+        for (int i = 0; i < 100; ++i) {
+            assert(values[i] == i);
+        }
+        assert(results.drain().empty());
+    }
+
+    // Test 2: A job cancelled while it is queued never runs, so it posts
+    // nothing, and the jobs after it still run
+    {
+        WorkerPool pool(1);
+        ResultQueue<int> results;
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        pool.submit([released]() { released.wait(); });
+
+        auto cancelled = std::make_shared<std::atomic<bool>>(false);
+        std::atomic<bool> ran{false};
+        pool.submit(
+            [&results, &ran]() {
+                ran = true;
+                results.push(1);
+            },
+            cancelled);
+        pool.submit([&results]() { results.push(2); });
+        cancelled->store(true);
+        release.set_value();
+
+        // The only worker runs the jobs in order, so the cancelled one is
+        // done with once the last one posted
+        assert(drainAll(results, 1) == std::vector<int>{2});
+        assert(!ran);
+    }
+
+    // Test 3: The destructor waits for the running job and drops the
+    // queued ones
+    {
+        std::atomic<bool> finished{false};
+        std::atomic<int> numRun{0};
+        std::promise<void> started;
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        std::thread releaser;
+        {
+            WorkerPool pool(1);
+            pool.submit([&started, released, &finished]() {
+                started.set_value();
+                released.wait();
+                finished = true;
+            });
+            for (int i = 0; i < 5; ++i) {
+                pool.submit([&numRun]() { ++numRun; });
+            }
+            started.get_future().wait();
+            // Lets the running job finish while the destructor waits for it
+            releaser = std::thread([&release]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                release.set_value();
+            });
+        }
+        assert(finished);
+        assert(numRun == 0);
+        releaser.join();
+    }
+}
+
+int main() {
+    testWorkerPool();
+    return 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "WorkerPool.hpp"
+#include "typesDefinition.hpp"
+
+using ThumbnailsInFlight =
+    std::unordered_map<std::size_t, WorkerPool::CancelFlag>;
+
+// Sorts the thumbnails to load from the most wanted to the least. The
+// visible ones come first, from the cursor outwards. Then the rows out of
+// view by their distance to the visible ones, where the rows the user is
+// scrolling away from count twice. scrollDirection is 1 when scrolling down,
+// -1 when scrolling up.
+void sortThumbnailsToLoad(std::vector<std::size_t>& indices,
+                          const GridImagesState& gridImagesState,
+                          int scrollDirection, int currentImage);
+
+// Takes the job of a decoded thumbnail out of the ones in flight. Returns
+// false if the job was cancelled and the thumbnail submitted again since
+// then: the result is stale, the new job uploads it.
+auto takeFromFlight(ThumbnailsInFlight& inFlight, std::size_t index,
+                    const WorkerPool::CancelFlag& cancelled) -> bool;
+
+//**************************************************************
+//********************* Implementation *************************
+//**************************************************************
+
+void sortThumbnailsToLoad(std::vector<std::size_t>& indices,
+                          const GridImagesState& gridImagesState,
+                          int scrollDirection, int currentImage) {
+    int numColumns      = std::max(gridImagesState.numColumns, 1);
+    int firstVisibleRow = gridImagesState.rowsScroll;
+    int lastVisibleRow  = firstVisibleRow + gridImagesState.numRows - 1;
+
+    const auto getPriority = [&](std::size_t index) {
+        int row = (int)index / numColumns;
+        int rowDistance = 0;
+        bool isBehind   = false;
+        if (row < firstVisibleRow) {
+            rowDistance = firstVisibleRow - row;
+            isBehind    = scrollDirection > 0;
+        } else if (row > lastVisibleRow) {
+            rowDistance = row - lastVisibleRow;
+            isBehind    = scrollDirection < 0;
+        }
+        return std::make_tuple(isBehind ? 2 * rowDistance : rowDistance,
+                               std::abs((int)index - currentImage));
+    };
+    std::sort(indices.begin(), indices.end(),
+              [&](std::size_t a, std::size_t b) {
+                  return getPriority(a) < getPriority(b);
+              });
+}
+
+auto takeFromFlight(ThumbnailsInFlight& inFlight, std::size_t index,
+                    const WorkerPool::CancelFlag& cancelled) -> bool {
+    auto it = inFlight.find(index);
+    if (it == inFlight.end()) {
+        return true;
+    }
+    if (it->second != cancelled) {
+        return false;
+    }
+    inFlight.erase(it);
+    return true;
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cmath>
+
+#include "sdlUtils.hpp"
+#include "typesDefinition.hpp"
+
+// Images bigger than the maximum texture size, like panoramas and scans,
+// cannot be uploaded as one texture. They are kept decoded in CPU memory and
+// split in square tiles. Each frame only the tiles that intersect the window
+// are uploaded, and the ones that left it are destroyed. When the image is
+// not zoomed past the resolution of the overview, which is the image
+// downscaled to fit in a texture, the overview is drawn instead.
+//
+// It must only be used from the main thread, except needsTiling.
+
+auto needsTiling(int width, int height, int maxTextureSize) -> bool;
+
+// Takes the decoded image and the overview, which should be made with
+// createThumbnailSurface(image, maxTextureSize, maxTextureSize) in a worker.
+auto createTiledImage(const SdlRenderer& renderer, SdlSurface image,
+                      SDL_Surface* overview) -> std::optional<TiledImage>;
+
+// Draws it like SDL_RenderCopyEx would draw the whole image in imageRect,
+// rotated around its center. The tiles outside viewport are evicted.
+void drawTiledImage(const SdlRenderer& renderer, TiledImage& tiledImage,
+                    const SDL_Rect& imageRect, const SDL_Rect& viewport,
+                    double angle = 0., SDL_RendererFlip flip = SDL_FLIP_NONE);
+
+// Bytes of the decoded pixels, the overview and the uploaded tiles
+auto getTiledImageMemory(const TiledImage& tiledImage) -> long;
+
+//**************************************************************
+//********************* Implementation *************************
+//**************************************************************
+
+auto needsTiling(int width, int height, int maxTextureSize) -> bool {
+    return width > maxTextureSize || height > maxTextureSize;
+}
+
+auto createTiledImage(const SdlRenderer& renderer, SdlSurface image,
+                      SDL_Surface* overview) -> std::optional<TiledImage> {
+    // Small enough that zooming in only uploads a few MB per new tile
+    constexpr static int kTileSize = 1024;
+
+    // The tiles are uploaded straight from the pixels of the surface, which
+    // needs a format textures can have
+    if (SDL_ISPIXELFORMAT_INDEXED(image->format->format)) {
+        SDL_Surface* converted =
+            SDL_ConvertSurfaceFormat(image.get(), SDL_PIXELFORMAT_RGBA32, 0);
+        if (converted == nullptr) {
+            return std::nullopt;
+        }
+        image = createSurface(converted);
+    }
+    SDL_Texture* overviewTexture =
+        SDL_CreateTextureFromSurface(renderer.get(), overview);
+    if (overviewTexture == nullptr) {
+        return std::nullopt;
+    }
+    int tileSize = std::min(kTileSize, getMaxTextureSize(renderer));
+    return TiledImage{std::move(image), createTexture(overviewTexture),
+                      tileSize};
+}
+
+void drawTiledImage(const SdlRenderer& renderer, TiledImage& tiledImage,
+                    const SDL_Rect& imageRect, const SDL_Rect& viewport,
+                    double angle, SDL_RendererFlip flip) {
+    SDL_Surface* surface = tiledImage.surface.get();
+    int overviewWidth, overviewHeight;
+    SDL_QueryTexture(tiledImage.overview.get(), nullptr, nullptr,
+                     &overviewWidth, &overviewHeight);
+    if (imageRect.w <= overviewWidth && imageRect.h <= overviewHeight) {
+        tiledImage.tiles.clear();
+        SDL_RenderCopyEx(renderer.get(), tiledImage.overview.get(), nullptr,
+                         &imageRect, angle, nullptr, flip);
+        return;
+    }
+
+    int tileSize   = tiledImage.tileSize;
+    int numColumns = (surface->w + tileSize - 1) / tileSize;
+    int numRows    = (surface->h + tileSize - 1) / tileSize;
+    float scaleX   = (float)imageRect.w / surface->w;
+    float scaleY   = (float)imageRect.h / surface->h;
+    float centerX  = imageRect.x + imageRect.w / 2.f;
+    float centerY  = imageRect.y + imageRect.h / 2.f;
+    float cosAngle = (float)std::cos(angle * M_PI / 180.);
+    float sinAngle = (float)std::sin(angle * M_PI / 180.);
+
+    // Bounding box of the rect once rotated around the image center
+    const auto isVisible = [&](const SDL_FRect& rect) {
+        float minX = INFINITY, minY = INFINITY;
+        float maxX = -INFINITY, maxY = -INFINITY;
+        for (auto [x, y] : {std::pair{rect.x, rect.y},
+                            std::pair{rect.x + rect.w, rect.y},
+                            std::pair{rect.x, rect.y + rect.h},
+                            std::pair{rect.x + rect.w, rect.y + rect.h}}) {
+            float dx = x - centerX;
+            float dy = y - centerY;
+            float rotatedX = centerX + dx * cosAngle - dy * sinAngle;
+            float rotatedY = centerY + dx * sinAngle + dy * cosAngle;
+            minX = std::min(minX, rotatedX);
+            maxX = std::max(maxX, rotatedX);
+            minY = std::min(minY, rotatedY);
+            maxY = std::max(maxY, rotatedY);
+        }
+        return maxX > viewport.x && minX < viewport.x + viewport.w &&
+               maxY > viewport.y && minY < viewport.y + viewport.h;
+    };
+
+    const auto uploadTile = [&](const SDL_Rect& sourceRect) -> SDL_Texture* {
+        Uint32 format        = surface->format->format;
+        SDL_Texture* texture = SDL_CreateTexture(
+            renderer.get(), format, SDL_TEXTUREACCESS_STATIC, sourceRect.w,
+            sourceRect.h);
+        if (texture == nullptr) {
+            return nullptr;
+        }
+        const Uint8* pixels = (const Uint8*)surface->pixels +
+                              (std::size_t)sourceRect.y * surface->pitch +
+                              (std::size_t)sourceRect.x *
+                                  surface->format->BytesPerPixel;
+        SDL_UpdateTexture(texture, nullptr, pixels, surface->pitch);
+        if (SDL_ISPIXELFORMAT_ALPHA(format)) {
+            SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+        }
+        return texture;
+    };
+
+    for (int row = 0; row < numRows; ++row) {
+        for (int column = 0; column < numColumns; ++column) {
+            int key = row * numColumns + column;
+            SDL_Rect sourceRect{column * tileSize, row * tileSize, tileSize,
+                                tileSize};
+            sourceRect.w = std::min(tileSize, surface->w - sourceRect.x);
+            sourceRect.h = std::min(tileSize, surface->h - sourceRect.y);
+            // A flipped image has its tiles in mirrored positions, and each
+            // tile is flipped when it is drawn
+            int x = (flip & SDL_FLIP_HORIZONTAL)
+                        ? surface->w - sourceRect.x - sourceRect.w
+                        : sourceRect.x;
+            int y = (flip & SDL_FLIP_VERTICAL)
+                        ? surface->h - sourceRect.y - sourceRect.h
+                        : sourceRect.y;
+            SDL_FRect destRect{imageRect.x + x * scaleX,
+                               imageRect.y + y * scaleY, sourceRect.w * scaleX,
+                               sourceRect.h * scaleY};
+            if (!isVisible(destRect)) {
+                tiledImage.tiles.erase(key);
+                continue;
+            }
+
+            auto tile = tiledImage.tiles.find(key);
+            if (tile == tiledImage.tiles.end()) {
+                SDL_Texture* texture = uploadTile(sourceRect);
+                if (texture == nullptr) {
+                    continue;
+                }
+                tile = tiledImage.tiles.emplace(key, createTexture(texture))
+                           .first;
+            }
+            // All the tiles rotate around the center of the image
+            SDL_FPoint center{centerX - destRect.x, centerY - destRect.y};
+            SDL_RenderCopyExF(renderer.get(), tile->second.get(), nullptr,
+                              &destRect, angle, &center, flip);
+        }
+    }
+}
+
+auto getTiledImageMemory(const TiledImage& tiledImage) -> long {
+    long memory = (long)tiledImage.surface->h * tiledImage.surface->pitch +
+                  getTextureMemory(tiledImage.overview.get());
+    for (const auto& [key, tile] : tiledImage.tiles) {
+        memory += getTextureMemory(tile.get());
+    }
+    return memory;
+}
@@ -2,9 +2,12 @@
 #include "SDL.h"
 #include "SDL_image.h"
 #include "SDL_ttf.h"
+#include <algorithm>
 #include <array>
+#include <deque>
 #include <memory>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <unordered_map>
 #include <unordered_set>
@@ -15,6 +18,7 @@
 using SdlWindow   = std::unique_ptr<SDL_Window, void (*)(SDL_Window*)>;
 using SdlRenderer = std::unique_ptr<SDL_Renderer, void (*)(SDL_Renderer*)>;
 using SdlTexture  = std::unique_ptr<SDL_Texture, void (*)(SDL_Texture*)>;
+using SdlSurface  = std::unique_ptr<SDL_Surface, void (*)(SDL_Surface*)>;
 using SdlFont     = std::unique_ptr<TTF_Font, void (*)(TTF_Font*)>;
 
 using Color = std::array<Uint8, 3>;
@@ -24,10 +28,57 @@ struct ConfigStruct {
 };
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(ConfigStruct, keyCommands);
 
+class GifDecoder;
+
+// Area of the canvas a frame changes from the previous one, usually much
+// smaller than the canvas
+struct AnimationFrame {
+    SDL_Rect rect;
+    // RGBA32, rect.w * 4 bytes per row
+    std::vector<Uint8> pixels;
+    int index;
+    // Milliseconds
+    int delay;
+};
+
+// Animations are decoded while they play. Only a few frames ahead of the
+// one on screen are kept, as the areas they change, and they are copied to
+// a single texture when they are shown.
 struct SdlAnimation {
-    std::vector<SdlTexture> frames;
+    std::shared_ptr<GifDecoder> decoder;
+    SdlTexture texture{nullptr, &SDL_DestroyTexture};
+    // The first one is on screen
+    std::deque<AnimationFrame> frames;
     int actualFrame{0};
-    int fps{24};
+    // SDL_GetPerformanceCounter value when the next frame is due, 0 until
+    // the animation is first drawn
+    Uint64 nextFrameTime{0};
+};
+
+// Half resolution levels of a still image, built by the workers after it is
+// decoded. The ImageHeader texture holds the level that is being drawn, so
+// the full resolution one is only resident while it is needed.
+struct ImagePyramid {
+    // Each level is half the previous one, and they stay in CPU memory.
+    // levels[0] is the decoded image, which is released once the others are
+    // built, so it is empty.
+    std::vector<SdlSurface> levels;
+    int uploadedLevel{0};
+    // Set when the image is drawn big enough to need the full resolution,
+    // which the loader decodes again. Meanwhile level 1 is drawn.
+    bool needsFullResolution{false};
+};
+
+// Image bigger than the maximum texture size of the renderer. The decoded
+// pixels stay in CPU memory and only the tiles on screen are uploaded.
+struct TiledImage {
+    SdlSurface surface;
+    // The image downscaled to fit in a texture, drawn instead of the tiles
+    // while it is not zoomed past the resolution of the overview
+    SdlTexture overview;
+    int tileSize;
+    // Uploaded tiles, by row * numColumns + column
+    std::unordered_map<int, SdlTexture> tiles{};
 };
 
 struct WindowSettings {
@@ -42,6 +93,37 @@ struct WindowSettings {
     bool useBilinearInterpolation{true};
 };
 
+enum class ThumbnailScaling { Automatic, Cpu, Gpu };
+
+struct LoaderSettings {
+    // Number of threads decoding thumbnails. With 0 the thumbnails are
+    // decoded synchronously in the main loop.
+    int numThreads{std::max(1, (int)std::thread::hardware_concurrency() - 1)};
+    // Where the synchronous path downscales the thumbnails. Automatic uses
+    // the CPU when the renderer is the software one. The worker threads
+    // always downscale in the CPU.
+    ThumbnailScaling thumbnailScaling{ThumbnailScaling::Automatic};
+    // Size limit in bytes of the thumbnails saved on disk. With 0 they are
+    // not saved.
+    long thumbnailStoreSize{512L * 1024 * 1024};
+    // Milliseconds per frame the main loop spends decoding thumbnails when
+    // there are no threads. At least one is decoded per frame.
+    int frameBudget{8};
+    // Images decoded by the threads ahead of the current one in the image
+    // view, and half as many behind
+    int prefetchImages{2};
+    // Size limit in bytes of the decoded full images kept in memory after
+    // leaving the view
+    long imageCacheSize{512L * 1024 * 1024};
+    // Size limit in bytes of all the decoded pixels: thumbnails, images and
+    // animation frames. The image cache is reduced first, then the
+    // thumbnails out of view are released.
+    long memoryBudget{2048L * 1024 * 1024};
+    // Save the thumbnails computed by aiv in the freedesktop shared
+    // thumbnails directory, so other programs can use them
+    bool writeSharedThumbnails{false};
+};
+
 struct Style {
     int thumbnailSize{100};
     int padding{20};
@@ -72,16 +154,36 @@ struct ImageViewerState {
     float zoom{1.};
     int panningX{0};
     int panningY{0};
+
+    // Animation commands, applied to the current image when it is drawn
+    bool animationPaused{false};
+    // Frames to step from the one on screen
+    int animationStep{0};
+    std::optional<int> animationSeek{std::nullopt};
+};
+
+// Rectangle of a page of the ThumbnailAtlas
+struct AtlasRegion {
+    int page;
+    SDL_Rect rect;
 };
 
 struct ImageHeader {
     std::optional<SdlTexture> image{std::nullopt};
-    std::optional<SdlTexture> thumbnail{std::nullopt};
+    std::optional<ImagePyramid> pyramid{std::nullopt};
+    std::optional<AtlasRegion> thumbnail{std::nullopt};
+    // Size the thumbnail was decoded at, one of the loader levels
+    int thumbnailLevel{0};
     std::optional<SdlAnimation> animation{std::nullopt};
+    std::optional<TiledImage> tiledImage{std::nullopt};
 
+    // Size of the file on disk
     long memory{10};
     int width{6000};
     int height{6000};
+    // Read from the header by probeImages. 0 frames when it is unknown
+    int numFrames{0};
+    int orientation{1};
     std::string fileAdress{""};
 };
 
@@ -90,6 +192,7 @@ struct SdlContext {
     SdlRenderer renderer;
     std::optional<SdlFont> font{std::nullopt};
     WindowSettings windowSettings{};
+    LoaderSettings loaderSettings{};
     Style style{};
 
     GridImagesState gridImagesState;
@@ -99,8 +202,15 @@ struct SdlContext {
     std::unordered_set<std::size_t> imagesToLoad;
     bool isGridImages{true};
     bool showBar{true};
+    // Shows in the bottom bar the time it takes to draw it
+    bool showStats{false};
     bool contiguousView{false};
-    int fps{24};
+    // Maximum redraws per second. Frames are only drawn when something
+    // changes, so it is only reached while loading or on key repeat.
+    int fps{60};
+    // Earliest frame deadline of the animations drawn in this frame, 0 if
+    // there are none
+    Uint64 animationDeadline{0};
     int currentImage{0};
     std::unordered_set<std::size_t> selectedImages{};
     bool exit{false};